@@ -7,6 +7,7 @@
 #include "threads/malloc.h"
 #include "filesys/fat.h"
 #include "threads/thread.h"
+#include "threads/synch.h"
 #include <stdbool.h>
 
 
@@ -23,6 +24,17 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Guards the entries of every directory.  Lookups and readdir
+ * share it; dir_add() and dir_remove() hold it exclusively so
+ * that checking for a name and filling a slot are atomic. */
+static struct rwlock dir_lock;
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	rwlock_init (&dir_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -173,6 +185,7 @@ dir_lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	rwlock_acquire_read (&dir_lock);
 	if(!strcmp(name, "."))
 		*inode = inode_reopen(dir->inode);
 
@@ -183,6 +196,7 @@ dir_lookup (const struct dir *dir, const char *name,
 		*inode = inode_open (e.inode_sector);
 	else
 		*inode = NULL;
+	rwlock_release_read (&dir_lock);
 
 	return *inode != NULL;
 }
@@ -207,8 +221,10 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	rwlock_acquire_write (&dir_lock);
+
+	/* Check that DIR was not removed and NAME is not in use. */
+	if (inode_removed (dir->inode) || lookup (dir, name, NULL, NULL))
 		goto done;
 
 	/* Set OFS to offset of free slot.
@@ -242,6 +258,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	inode_close(child_inode);
 
 done:
+	rwlock_release_write (&dir_lock);
 	return success;
 }
 
@@ -258,6 +275,8 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	rwlock_acquire_write (&dir_lock);
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -289,6 +308,7 @@ dir_remove (struct dir *dir, const char *name) {
 	success = true;
 
 done:
+	rwlock_release_write (&dir_lock);
 	inode_close (inode);
 	return success;
 }
@@ -299,13 +319,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	rwlock_acquire_read (&dir_lock);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	rwlock_release_read (&dir_lock);
+	return found;
 }
\ No newline at end of file
@@ -23,7 +23,7 @@ struct fat_fs {
 	unsigned int fat_length;
 	disk_sector_t data_start;
 	cluster_t last_clst;
-	struct lock write_lock;
+	struct mutex write_lock;
 };
 
 static struct fat_fs *fat_fs;
@@ -161,7 +161,7 @@ fat_fs_init (void) {
 	
 	fat_fs->last_clst = fat_fs->bs.root_dir_cluster + 1;
 
-	lock_init(&fat_fs->write_lock);
+	mutex_init(&fat_fs->write_lock, "fat");
 }
 
 /*----------------------------------------------------------------------------*/
@@ -174,14 +174,16 @@ fat_fs_init (void) {
 cluster_t
 fat_create_chain (cluster_t clst) {
 	/* TODO: Your code goes here. */
-	lock_acquire(&fat_fs->write_lock);
+	mutex_acquire(&fat_fs->write_lock);
 	cluster_t new_clst = fat_fs->last_clst;
 
 	/* fat_fs->last_clst update */
 	while(fat_get(new_clst) != 0){
 		new_clst++;
-		if(new_clst > (fat_fs->fat_length - 1))
+		if(new_clst > (fat_fs->fat_length - 1)){
+			mutex_release(&fat_fs->write_lock);
 			return 0;
+		}
 	}
     
 	ASSERT(fat_fs->bs.root_dir_cluster < new_clst &&
@@ -191,7 +193,7 @@ fat_create_chain (cluster_t clst) {
 	fat_put(new_clst, EOChain);
 
 	fat_fs->last_clst = new_clst + 1;
-	lock_release(&fat_fs->write_lock);
+	mutex_release(&fat_fs->write_lock);
 	return new_clst;
 }
 
@@ -201,7 +203,7 @@ void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
 	/* TODO: Your code goes here. */
 
-	lock_acquire(&fat_fs->write_lock);
+	mutex_acquire(&fat_fs->write_lock);
 	if(pclst){
 		ASSERT(fat_get(pclst) == clst);
 		fat_put(pclst, EOChain);
@@ -221,7 +223,7 @@ fat_remove_chain (cluster_t clst, cluster_t pclst) {
 		
 		curr = next;
 	}
-	lock_release(&fat_fs->write_lock);
+	mutex_release(&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
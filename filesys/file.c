@@ -108,6 +108,48 @@ file_write_at (struct file *file, const void *buffer, off_t size,
 	return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads from FILE into the IOVCNT segments of IOV in order,
+ * starting at the file's current position, as one operation.
+ * Returns the total number of bytes read, which may be short if
+ * end of file is reached.
+ * Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt) {
+	off_t bytes_read = inode_readv_at (file->inode, iov, iovcnt, file->pos);
+	file->pos += bytes_read;
+	return bytes_read;
+}
+
+/* Reads from FILE into the IOVCNT segments of IOV in order,
+ * starting at offset FILE_OFS, as one operation.
+ * The file's current position is unaffected. */
+off_t
+file_readv_at (struct file *file, const struct iovec *iov, int iovcnt,
+		off_t file_ofs) {
+	return inode_readv_at (file->inode, iov, iovcnt, file_ofs);
+}
+
+/* Writes the IOVCNT segments of IOV in order into FILE, starting
+ * at the file's current position, as one operation.
+ * Returns the total number of bytes written.
+ * Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt) {
+	off_t bytes_written = inode_writev_at (file->inode, iov, iovcnt,
+			file->pos);
+	file->pos += bytes_written;
+	return bytes_written;
+}
+
+/* Writes the IOVCNT segments of IOV in order into FILE, starting
+ * at offset FILE_OFS, as one operation.
+ * The file's current position is unaffected. */
+off_t
+file_writev_at (struct file *file, const struct iovec *iov, int iovcnt,
+		off_t file_ofs) {
+	return inode_writev_at (file->inode, iov, iovcnt, file_ofs);
+}
+
 /* Prevents write operations on FILE's underlying inode
  * until file_allow_write() is called or FILE is closed. */
 void
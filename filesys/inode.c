@@ -2,10 +2,13 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdint.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "filesys/fat.h"
 
 /* Identifies an inode. */
@@ -36,6 +39,8 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	uint64_t change_seq;                /* Bumped by every change. */
+	struct rwlock rwlock;               /* Guards data and file contents. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -65,10 +70,46 @@ byte_to_sector (const struct inode *inode, off_t pos) {
  * returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Guards open_inodes and the open_cnt and removed members of every
+ * inode in it.  File contents are guarded by each inode's own
+ * rwlock, so I/O on different inodes never contends here. */
+static struct lock open_inodes_lock;
+
+/* Slab cache for in-memory inodes. */
+static struct kmem_cache *inode_cachep;
+
+/* Slab cache for the sector-sized bounce buffers that partial
+ * sector transfers go through. */
+static struct kmem_cache *bounce_cachep;
+
+/* Called with an inode's sector number whenever its contents
+ * change or it is freed, if set. */
+static inode_change_func *change_func;
+
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	lock_init (&open_inodes_lock);
+	inode_cachep = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+	bounce_cachep = kmem_cache_create ("bounce", DISK_SECTOR_SIZE, NULL);
+}
+
+/* Registers FUNC to be told about inodes that are written or
+ * freed, so that it can drop anything it derived from them. */
+void
+inode_set_change_func (inode_change_func *func) {
+	change_func = func;
+}
+
+/* Bumps INODE's change sequence number, then tells the change
+ * function, if any, that INODE has changed. */
+static void
+notify_change (struct inode *inode) {
+	inode->change_seq++;
+	barrier ();
+	if (change_func != NULL)
+		change_func (inode->sector);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -128,36 +169,47 @@ inode_open (disk_sector_t sector) {
 	struct list_elem *e;
 	struct inode *inode;
 
+	lock_acquire (&open_inodes_lock);
+
 	/* Check whether this inode is already open. */
 	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
 			e = list_next (e)) {
 		inode = list_entry (e, struct inode, elem);
 		if (inode->sector == sector) {
-			inode_reopen (inode);
+			inode->open_cnt++;
+			lock_release (&open_inodes_lock);
 			return inode; 
 		}
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = kmem_cache_alloc (inode_cachep);
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
 	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
+	inode->change_seq = 0;
 	inode->removed = false;
+	rwlock_init (&inode->rwlock);
 	disk_read (filesys_disk, inode->sector, &inode->data);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -167,6 +219,13 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
+/* Returns INODE's change sequence number, which every write to
+ * INODE bumps before telling the change function about it. */
+uint64_t
+inode_change_seq (const struct inode *inode) {
+	return inode->change_seq;
+}
+
 /* Closes INODE and writes it to disk.
  * If this was the last reference to INODE, frees its memory.
  * If INODE was also a removed inode, frees its blocks. */
@@ -177,18 +236,23 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
+	lock_acquire (&open_inodes_lock);
 	if (--inode->open_cnt == 0) {
 		/* Remove from inode list and release lock. */
 		list_remove (&inode->elem);
+		lock_release (&open_inodes_lock);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+			notify_change (inode);
 			fat_remove_chain (inode->sector, 0);
 			fat_remove_chain (inode->data.start, 0); 
 		}
 
-		free (inode); 
+		kmem_cache_free (inode_cachep, inode);
 	}
+	else
+		lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -196,22 +260,68 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&open_inodes_lock);
 	inode->removed = true;
+	lock_release (&open_inodes_lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
- * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
-	uint8_t *buffer = buffer_;
+/* Returns the sector after SECTOR in its cluster chain, or -1 if
+ * SECTOR is the last. */
+static disk_sector_t
+next_sector (disk_sector_t sector) {
+	cluster_t next = fat_get (sector_to_cluster (sector));
+	return next == EOChain ? (disk_sector_t) -1 : cluster_to_sector (next);
+}
+
+/* Returns how many sectors of the cluster chain starting at FIRST,
+ * up to MAX of them and no more than DISK_RUN_MAX, lie one after
+ * another on disk and so can move with a single command.  Stores
+ * the sector that follows them in the chain in *NEXT. */
+static int
+sector_run (disk_sector_t first, off_t max, disk_sector_t *next) {
+	disk_sector_t sector = next_sector (first);
+	int cnt = 1;
+
+	while (cnt < max && cnt < DISK_RUN_MAX && sector == first + cnt) {
+		sector = next_sector (sector);
+		cnt++;
+	}
+	*next = sector;
+	return cnt;
+}
+
+/* Returns *BOUNCE, first allocating it if it is null, or a null
+ * pointer if memory is exhausted. */
+static uint8_t *
+get_bounce (uint8_t **bounce) {
+	if (*bounce == NULL)
+		*bounce = kmem_cache_alloc (bounce_cachep);
+	return *bounce;
+}
+
+/* Frees BOUNCE, as allocated by get_bounce(), if it is not null. */
+static void
+put_bounce (uint8_t *bounce) {
+	kmem_cache_free (bounce_cachep, bounce);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+ * OFFSET, with INODE's lock held for reading.  Runs of whole
+ * sectors that are consecutive on disk go straight into BUFFER
+ * with one disk command each.  *BOUNCE is a sector-sized scratch
+ * buffer for partial sectors, allocated on first use, that the
+ * caller must free with put_bounce().  Returns the number of bytes
+ * read. */
+static off_t
+read_locked (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+		uint8_t **bounce) {
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+	/* Disk sector to read.  Follows OFFSET down the cluster chain,
+	 * which is walked from the start only once. */
+	disk_sector_t sector_idx = byte_to_sector (inode, offset);
 
 	while (size > 0) {
-		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
-		
+		/* Starting byte offset within sector. */
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -225,18 +335,24 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+			/* Read whole sectors directly into caller's buffer. */
+			off_t whole = (size < inode_left ? size : inode_left)
+				/ DISK_SECTOR_SIZE;
+			disk_sector_t next;
+			int cnt = sector_run (sector_idx, whole, &next);
+
+			disk_read_run (filesys_disk, sector_idx, cnt, buffer + bytes_read);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
+			sector_idx = next;
 		} else {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+			if (get_bounce (bounce) == NULL)
+				break;
+			disk_read (filesys_disk, sector_idx, *bounce);
+			memcpy (buffer + bytes_read, *bounce + sector_ofs, chunk_size);
+			if (chunk_size == sector_left)
+				sector_idx = next_sector (sector_idx);
 		}
 
 		/* Advance. */
@@ -244,68 +360,101 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if an error occurs or end of file is reached.
+ * BUFFER must not fault: a fault under INODE's lock could evict a
+ * dirty page mapped from INODE, whose write-back needs the lock.
+ * User buffers are pinned by the caller for that reason. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	uint8_t *bounce = NULL;
+	off_t bytes_read;
+
+	rwlock_acquire_read (&inode->rwlock);
+	bytes_read = read_locked (inode, buffer, size, offset, &bounce);
+	rwlock_release_read (&inode->rwlock);
+	put_bounce (bounce);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
- * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+/* Reads from INODE into the IOVCNT segments of IOV in order,
+ * starting at position OFFSET, taking INODE's lock only once.
+ * Returns the total number of bytes read, which is short if an
+ * error occurs or end of file is reached. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_readv_at (struct inode *inode, const struct iovec *iov, int iovcnt,
 		off_t offset) {
-	const uint8_t *buffer = buffer_;
-	off_t bytes_written = 0;
 	uint8_t *bounce = NULL;
-	int length;
+	off_t bytes_read = 0;
 
-	if (inode->deny_write_cnt)
-		return 0;
+	rwlock_acquire_read (&inode->rwlock);
+	for (int i = 0; i < iovcnt; i++) {
+		off_t n = read_locked (inode, iov[i].iov_base, iov[i].iov_len,
+				offset + bytes_read, &bounce);
+		bytes_read += n;
+		if (n < (off_t) iov[i].iov_len)
+			break;
+	}
+	rwlock_release_read (&inode->rwlock);
+	put_bounce (bounce);
 
-	/* Implement file growth, extended file */
+	return bytes_read;
+}
 
-	bool file_growth = (offset + size) > inode_length(inode);
-	if(file_growth)
+/* Grows INODE to LENGTH bytes, allocating the clusters it needs,
+ * with INODE's lock held for writing.  Returns false if the disk
+ * is full. */
+static bool
+extend (struct inode *inode, off_t length) {
+	size_t sectors_after_growth = bytes_to_sectors(length);
+	size_t sectors_before_growth = bytes_to_sectors(inode_length(inode));
+	size_t additional_sectors = sectors_after_growth - sectors_before_growth;
+
+	disk_sector_t sector_head;
+	if(!fat_allocate(additional_sectors, &sector_head))
 	{
-		size_t sectors_after_growth = bytes_to_sectors(offset + size);
-		size_t sectors_before_growth = bytes_to_sectors(inode_length(inode));
-		size_t additional_sectors = sectors_after_growth - sectors_before_growth;
-
-		disk_sector_t sector_head;
-		if(fat_allocate(additional_sectors, &sector_head))
-		{
-			if(inode->data.start == 0){
-				inode->data.start = sector_head;
-			}
-			else if(additional_sectors != 0)
-			{
-				disk_sector_t sector_tail = byte_to_sector(inode, inode_length(inode) - 1);
-				
-				cluster_t clst_tail = sector_to_cluster(sector_tail);
-				cluster_t clst_head = sector_to_cluster(sector_head);
-
-				ASSERT(fat_get(clst_tail) == EOChain);
-				fat_put(clst_tail, clst_head);
-			}
+		/* fat allocate failed, no enough memory to allocate in disk */
+		return false;
+	}
 
-			/* inode data update */
-			inode->data.length = offset + size;
-			disk_write(filesys_disk, inode->sector, &inode->data);
+	if(inode->data.start == 0){
+		inode->data.start = sector_head;
+	}
+	else if(additional_sectors != 0)
+	{
+		disk_sector_t sector_tail = byte_to_sector(inode, inode_length(inode) - 1);
+		
+		cluster_t clst_tail = sector_to_cluster(sector_tail);
+		cluster_t clst_head = sector_to_cluster(sector_head);
 
-		}
-		else{
-			/* fat allocate failed, no enough memory to allocate in disk */
-			return 0;
-		}
+		ASSERT(fat_get(clst_tail) == EOChain);
+		fat_put(clst_tail, clst_head);
 	}
 
+	/* inode data update */
+	inode->data.length = length;
+	disk_write(filesys_disk, inode->sector, &inode->data);
+	return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+ * which must lie within INODE's length, with INODE's lock held for
+ * writing.  Whole sectors and *BOUNCE are handled as in
+ * read_locked().  Returns the number of bytes written. */
+static off_t
+write_locked (struct inode *inode, const uint8_t *buffer, off_t size,
+		off_t offset, uint8_t **bounce) {
+	off_t bytes_written = 0;
+	/* Sector to write, followed down the chain as in read_locked(). */
+	disk_sector_t sector_idx = byte_to_sector (inode, offset);
+
 	while (size > 0) {
-			
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		/* Starting byte offset within sector. */
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -319,25 +468,32 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+			/* Write whole sectors directly to disk. */
+			off_t whole = (size < inode_left ? size : inode_left)
+				/ DISK_SECTOR_SIZE;
+			disk_sector_t next;
+			int cnt = sector_run (sector_idx, whole, &next);
+
+			disk_write_run (filesys_disk, sector_idx, cnt,
+					buffer + bytes_written);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
+			sector_idx = next;
 		} else {
 			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
+			if (get_bounce (bounce) == NULL)
+				break;
 
 			/* If the sector contains data before or after the chunk
 			   we're writing, then we need to read in the sector
 			   first.  Otherwise we start with a sector of all zeros. */
 			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
+				disk_read (filesys_disk, sector_idx, *bounce);
 			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+				memset (*bounce, 0, DISK_SECTOR_SIZE);
+			memcpy (*bounce + sector_ofs, buffer + bytes_written, chunk_size);
+			disk_write (filesys_disk, sector_idx, *bounce); 
+			if (chunk_size == sector_left)
+				sector_idx = next_sector (sector_idx);
 		}
 
 		/* Advance. */
@@ -345,7 +501,78 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	if(bounce) free (bounce);
+	return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if the disk is full or an error occurs.  Writes
+ * past end of file extend the inode, but a write that would end
+ * past the largest off_t writes nothing.  BUFFER must not fault,
+ * as in inode_read_at(). */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	uint8_t *bounce = NULL;
+	off_t bytes_written = 0;
+
+	/* Writers are exclusive: growth rewrites the FAT chain and the
+	   on-disk inode, which readers walk without other locking. */
+	rwlock_acquire_write (&inode->rwlock);
+	if (inode->deny_write_cnt || offset < 0 || size > INT32_MAX - offset)
+		goto done;
+
+	/* Implement file growth, extended file */
+	if (offset + size > inode_length (inode)
+			&& !extend (inode, offset + size))
+		goto done;
+
+	bytes_written = write_locked (inode, buffer, size, offset, &bounce);
+	if (bytes_written > 0)
+		notify_change (inode);
+
+done:
+	rwlock_release_write (&inode->rwlock);
+	put_bounce (bounce);
+
+	return bytes_written;
+}
+
+/* Writes the IOVCNT segments of IOV in order into INODE, starting
+ * at OFFSET, taking INODE's lock only once and growing INODE at
+ * most once.  Returns the total number of bytes written, which is
+ * short if the disk is full or an error occurs. */
+off_t
+inode_writev_at (struct inode *inode, const struct iovec *iov, int iovcnt,
+		off_t offset) {
+	uint8_t *bounce = NULL;
+	off_t bytes_written = 0;
+	off_t size = 0;
+
+	for (int i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
+	rwlock_acquire_write (&inode->rwlock);
+	if (inode->deny_write_cnt || offset < 0 || size > INT32_MAX - offset)
+		goto done;
+
+	if (offset + size > inode_length (inode)
+			&& !extend (inode, offset + size))
+		goto done;
+
+	for (int i = 0; i < iovcnt; i++) {
+		off_t n = write_locked (inode, iov[i].iov_base, iov[i].iov_len,
+				offset + bytes_written, &bounce);
+		bytes_written += n;
+		if (n < (off_t) iov[i].iov_len)
+			break;
+	}
+	if (bytes_written > 0)
+		notify_change (inode);
+
+done:
+	rwlock_release_write (&inode->rwlock);
+	put_bounce (bounce);
 
 	return bytes_written;
 }
@@ -355,8 +582,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rwlock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -364,9 +593,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rwlock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -15,6 +15,9 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Most sectors one disk_read_run() or disk_write_run() moves. */
+#define DISK_RUN_MAX 256
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +25,8 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_run (struct disk *, disk_sector_t, int cnt, void *);
+void disk_write_run (struct disk *, disk_sector_t, int cnt, const void *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
@@ -3,14 +3,11 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
-#include "threads/synch.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
-struct lock filesys_lock;
-
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
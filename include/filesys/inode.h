@@ -1,22 +1,33 @@
 #ifndef FILESYS_INODE_H
 #define FILESYS_INODE_H
 
+#include <iovec.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 
 struct bitmap;
 
+/* Told the sector of an inode that has been written or freed. */
+typedef void inode_change_func (disk_sector_t);
+
 void inode_init (void);
+void inode_set_change_func (inode_change_func *);
 bool inode_create (disk_sector_t, off_t, enum file_type);
 struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
+uint64_t inode_change_seq (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv_at (struct inode *, const struct iovec *, int iovcnt,
+		off_t offset);
+off_t inode_writev_at (struct inode *, const struct iovec *, int iovcnt,
+		off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 
@@ -0,0 +1,16 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One segment of a buffer for the readv() and writev() system
+   calls. */
+struct iovec {
+	void *iov_base;             /* Start of the segment. */
+	size_t iov_len;             /* Length of the segment in bytes. */
+};
+
+/* Maximum number of segments in one readv() or writev() call. */
+#define IOV_MAX 1024
+
+#endif /* lib/iovec.h */
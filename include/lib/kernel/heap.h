@@ -0,0 +1,70 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Max-heap (pairing heap).
+ *
+ * Like the linked list in lib/kernel/list.h, this heap does not
+ * use dynamically allocated memory.  Each structure that can
+ * potentially be in a heap must embed a struct heap_elem member,
+ * and the heap_entry macro converts a struct heap_elem back to
+ * the structure that contains it.
+ *
+ * Elements are ordered by a heap_less_func supplied at
+ * initialization.  heap_max() returns the greatest element in
+ * O(1), heap_insert() runs in O(1), and heap_pop_max(),
+ * heap_remove() and heap_update() run in O(log n) amortized
+ * time.  Elements that compare equal come out in the order they
+ * were inserted, so a heap can replace a list kept sorted with
+ * list_insert_ordered() without changing FIFO behavior.
+ *
+ * If the key of an element in a heap changes, call
+ * heap_update() on it before the next operation on the heap.  */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* Leftmost child. */
+	struct heap_elem *sibling;  /* Next sibling to the right. */
+	struct heap_elem *prev;     /* Left sibling, or parent if leftmost. */
+	uint64_t seq;               /* Insertion order, breaks ties. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap {
+	struct heap_elem *root;     /* Greatest element, or NULL. */
+	size_t elem_cnt;            /* Number of elements. */
+	uint64_t next_seq;          /* Sequence number for next insert. */
+	heap_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_insert (struct heap *, struct heap_elem *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+struct heap_elem *heap_max (struct heap *);
+struct heap_elem *heap_pop_max (struct heap *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
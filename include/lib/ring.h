@@ -0,0 +1,75 @@
+#ifndef __LIB_RING_H
+#define __LIB_RING_H
+
+#include <stdint.h>
+
+/* Batched system call ring.
+
+   A process lays out a struct ring, followed by ENTRIES
+   submission entries and then ENTRIES completion entries, in its
+   own memory and registers it with ring_setup().  It then queues
+   requests by filling sq[sq_tail % ENTRIES] and advancing
+   sq_tail, and calls ring_enter() to have the kernel carry out as
+   many as it likes in a single trap.  For each request the kernel
+   consumes, it advances sq_head and posts the request's result,
+   tagged with its user_data, at cq[cq_tail % ENTRIES] before
+   advancing cq_tail.  The process advances cq_head as it reaps
+   completions; the kernel stops consuming requests while the
+   completion queue is full.
+
+   The indexes run freely and wrap around at 2**32, so ENTRIES
+   must be a power of two. */
+
+/* Maximum ring size in entries. */
+#define RING_MAX_ENTRIES 4096
+
+/* Request types. */
+enum ring_op {
+	RING_NOP,                   /* Do nothing, result 0. */
+	RING_READ,                  /* read (fd, addr, len). */
+	RING_WRITE,                 /* write (fd, addr, len). */
+	RING_PREAD,                 /* pread (fd, addr, len, off). */
+	RING_PWRITE,                /* pwrite (fd, addr, len, off). */
+	RING_OPEN,                  /* open (addr). */
+	RING_CLOSE,                 /* close (fd), result 0. */
+	RING_SEEK,                  /* seek (fd, off), result 0. */
+};
+
+/* Submission queue entry. */
+struct ring_sqe {
+	uint64_t user_data;         /* Copied to the completion. */
+	uint64_t addr;              /* Buffer or file name. */
+	uint32_t len;               /* Buffer length. */
+	int32_t off;                /* File offset. */
+	int32_t fd;                 /* File descriptor. */
+	uint32_t op;                /* One of enum ring_op. */
+};
+
+/* Completion queue entry. */
+struct ring_cqe {
+	uint64_t user_data;         /* From the submission. */
+	int64_t res;                /* What the system call returned,
+	                               or -1 for an unknown OP. */
+};
+
+/* Ring header. */
+struct ring {
+	volatile uint32_t sq_head;  /* Next request the kernel takes. */
+	volatile uint32_t sq_tail;  /* Next free request slot. */
+	volatile uint32_t cq_head;  /* Next completion to reap. */
+	volatile uint32_t cq_tail;  /* Next free completion slot. */
+	uint32_t entries;           /* Entries in each queue. */
+	uint32_t pad;
+};
+
+/* Number of bytes in a ring of ENTRIES entries. */
+#define RING_BYTES(ENTRIES)                                    \
+	(sizeof (struct ring) + (ENTRIES) * (sizeof (struct ring_sqe) \
+		+ sizeof (struct ring_cqe)))
+
+/* The submission and completion queues of ring R with ENTRIES
+   entries. */
+#define ring_sq(R) ((struct ring_sqe *) ((struct ring *) (R) + 1))
+#define ring_cq(R, ENTRIES) ((struct ring_cqe *) (ring_sq (R) + (ENTRIES)))
+
+#endif /* lib/ring.h */
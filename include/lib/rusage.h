@@ -0,0 +1,20 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Resource usage of a thread, as returned by the getrusage()
+   system call.  Times are in timer ticks (see TIMER_FREQ). */
+struct rusage {
+	int64_t user_ticks;         /* Ticks running in user mode. */
+	int64_t kernel_ticks;       /* Ticks running in kernel mode. */
+	int64_t wait_ticks;         /* Ticks spent ready but not running. */
+	int64_t voluntary_switches; /* Switches away because we blocked. */
+	int64_t involuntary_switches; /* Switches away while still ready. */
+	int64_t page_faults;        /* Page faults taken, handled or not. */
+	int64_t read_bytes;         /* Bytes returned by read(). */
+	int64_t written_bytes;      /* Bytes accepted by write(). */
+	int64_t syscalls;           /* System calls made. */
+};
+
+#endif /* lib/rusage.h */
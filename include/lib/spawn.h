@@ -0,0 +1,17 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* A file descriptor for the spawn() system call to give the new
+   process.  The child starts out with only the console, as fds 0
+   and 1, and then takes each action in order: CHILD_FD becomes a
+   copy of the parent's PARENT_FD, or is closed if PARENT_FD is
+   -1. */
+struct spawn_fd {
+	int parent_fd;              /* Parent's fd, or -1. */
+	int child_fd;               /* Child's fd. */
+};
+
+/* Maximum number of actions in one spawn() call. */
+#define SPAWN_FD_MAX 64
+
+#endif /* lib/spawn.h */
@@ -36,6 +36,30 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Kernel diagnostics. */
+	SYS_TRACE_DUMP,             /* Dump the scheduler trace buffer. */
+	SYS_GETRUSAGE,              /* Report resource usage. */
+	SYS_MEMSTAT,                /* Dump kernel memory usage. */
+
+	/* Vectored and positional I/O. */
+	SYS_READV,                  /* Read into several buffers. */
+	SYS_WRITEV,                 /* Write from several buffers. */
+	SYS_PREAD,                  /* Read at a given offset. */
+	SYS_PWRITE,                 /* Write at a given offset. */
+
+	/* Batched system calls. */
+	SYS_RING_SETUP,             /* Register a system call ring. */
+	SYS_RING_ENTER,             /* Run requests queued in the ring. */
+
+	/* Process creation. */
+	SYS_SPAWN,                  /* Start a new process from a file. */
+
+	/* Interprocess communication. */
+	SYS_PIPE,                   /* Create a pipe. */
+
+	/* Shared memory. */
+	SYS_MMAP_SHARED,            /* Map a new shared anonymous region. */
 };
 
 #endif /* lib/syscall-nr.h */
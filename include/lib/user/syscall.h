@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <iovec.h>
+#include <ring.h>
+#include <spawn.h>
+#include <rusage.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -50,6 +54,30 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Kernel diagnostics. */
+void trace_dump (void);
+int getrusage (struct rusage *);
+void memstat (void);
+
+/* Vectored and positional I/O. */
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+
+/* Batched system calls. */
+int ring_setup (struct ring *, unsigned entries);
+int ring_enter (unsigned to_submit);
+
+/* Process creation. */
+pid_t spawn (const char *cmd_line, const struct spawn_fd *fds, int fd_cnt);
+
+/* Interprocess communication. */
+int pipe (int fds[2]);
+
+/* Shared memory. */
+void *mmap_shared (void *addr, size_t length, int writable);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
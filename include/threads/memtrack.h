@@ -0,0 +1,26 @@
+#ifndef THREADS_MEMTRACK_H
+#define THREADS_MEMTRACK_H
+
+#include <stddef.h>
+
+/* Kernel memory accounting by call site.
+
+   Built only with -DMEMTRACK (see the Make.vars files).  Without
+   it, the hooks below expand to nothing, so the allocators pay
+   no cost at all.  memtrack_dump() exists in both builds. */
+
+#ifdef MEMTRACK
+void memtrack_alloc (const void *, size_t size, const void *site);
+void memtrack_free (const void *);
+#else
+#define memtrack_alloc(PTR, SIZE, SITE) ((void) 0)
+#define memtrack_free(PTR) ((void) 0)
+#endif
+
+/* Call site to charge an allocation to: the caller of the
+   function that uses it. */
+#define MEMTRACK_CALLER __builtin_return_address (0)
+
+void memtrack_dump (void);
+
+#endif /* threads/memtrack.h */
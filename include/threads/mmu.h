@@ -2,16 +2,31 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* A process-context identifier held by an address space.  The
+   TLB keeps entries tagged with different PCIDs apart, so
+   switching to an address space whose PCID is still valid needs
+   no TLB flush.  Zero-initialize before first use. */
+struct pcid {
+	uint16_t id;                /* PCID, or 0 if none assigned. */
+	uint64_t gen;               /* Generation ID was assigned in. */
+};
+
+uint64_t mmu_init (void);
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
+void pml4_reap (void);
+void pml4_reaper_start (void);
 void pml4_activate (uint64_t *pml4);
+void pml4_activate_pcid (uint64_t *pml4, struct pcid *);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
@@ -20,6 +35,10 @@ void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+bool pml4_for_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		pte_for_each_func *, void *aux);
+void pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt);
+
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
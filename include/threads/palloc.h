@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -14,10 +15,22 @@ enum palloc_flags {
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Moves the contents of in-use user page OLD_PAGE to free page
+   NEW_PAGE and redirects every reference to it.  Returns false,
+   without side effects, if OLD_PAGE cannot be moved. */
+typedef bool palloc_migrate_func (void *old_page, void *new_page);
+
+/* Frees pages that some subsystem holds on to lazily, so that a
+   failed allocation can be retried. */
+typedef void palloc_reclaim_func (void);
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_batch (void *pages[], size_t cnt);
+void palloc_set_migrate_func (palloc_migrate_func *);
+void palloc_set_reclaim_func (palloc_reclaim_func *);
 
 #endif /* threads/palloc.h */
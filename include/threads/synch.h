@@ -1,13 +1,15 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, by priority. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -16,23 +18,57 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics of a lock or mutex.  Named ones are
+   reported by synch_print_stats(). */
+struct lock_stats {
+	const char *name;           /* Name in reports, or NULL. */
+	uint64_t acquire_cnt;       /* # of acquisitions. */
+	uint64_t contend_cnt;       /* # of acquisitions that found it held. */
+	uint64_t spin_cnt;          /* # of those that got it by spinning. */
+	struct list_elem elem;      /* Element in list of named locks. */
+};
+
+void synch_print_stats (void);
+
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
 
-	struct list_elem lockelem;
+	struct list_elem lockelem;  /* Element in holder's `locks' list. */
+	struct lock_stats stats;    /* Contention statistics. */
 };
 
 void lock_init (struct lock *);
+void lock_set_name (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Mutex for short critical sections.
+
+   Cheaper than a lock: an uncontended acquire is one test under
+   disabled interrupts, with no semaphore or list manipulation.
+   A contended acquire spins while the holder is running on
+   another CPU and blocks otherwise.  Mutexes do not take part in
+   priority donation and cannot be used with condition
+   variables. */
+struct mutex {
+	struct thread *holder;      /* Thread holding mutex, or NULL. */
+	struct heap waiters;        /* Threads blocked on the mutex. */
+	struct lock_stats stats;    /* Contention statistics. */
+};
+
+void mutex_init (struct mutex *, const char *name);
+void mutex_acquire (struct mutex *);
+bool mutex_try_acquire (struct mutex *);
+void mutex_release (struct mutex *);
+bool mutex_held_by_current_thread (const struct mutex *);
+
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, by priority. */
 };
 
 void cond_init (struct condition *);
@@ -40,6 +76,27 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers, or a single
+   writer, may hold it at once.  Waiting writers block new
+   readers, so a stream of readers cannot starve a writer.  Not
+   recursive: a reader must not re-acquire for reading while a
+   writer may be waiting. */
+struct rwlock {
+	struct lock lock;           /* Protects the members below. */
+	struct condition readers_ok;    /* Signaled when readers may enter. */
+	struct condition writers_ok;    /* Signaled when a writer may enter. */
+	int reader_cnt;             /* # of threads holding it for reading. */
+	int waiting_writer_cnt;     /* # of writers waiting. */
+	struct thread *writer;      /* Thread holding it for writing. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
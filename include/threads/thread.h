@@ -2,14 +2,20 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <rusage.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/fixed-point.h"
+#include "threads/mmu.h"
 
 #ifdef VM
 #include "vm/vm.h"
 #endif
+#ifdef USERPROG
+#include "userprog/fdtable.h"
+#endif
 
 
 /* States in a thread's life cycle. */
@@ -108,28 +114,31 @@ struct thread {
 	
 	/* implement priority donation */
 	int original_priority;
-	struct list donor_list;
-	struct list_elem donor_elem;
 	struct lock *wait_for_what_lock;
 
-	struct list locks;
+	struct list locks;					/* locks held, donors wait in their heaps */
+
+	/* Shared between thread.c and synch.c. */
+	struct heap_elem waitelem;			/* Element in semaphore waiters heap. */
+	struct heap *wait_queue;			/* Heap ordering us while blocked. */
+	struct heap_elem *wait_queue_elem;	/* Our element in wait_queue. */
+
+	/* Owned by thread.c. */
+	struct rusage rusage;               /* Resource usage. */
+	int64_t ready_ticks;                /* Timer ticks when last made ready. */
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	struct pcid pcid;                   /* TLB tag for pml4. */
 
-	int next_fd;						/* next fd to insert */
-	struct list fd_list;				/* list of fd*/
+	struct fd_table fds;				/* Open files, indexed by fd. */
+	struct ring *ring;					/* Registered syscall ring, or NULL. */
+	uint32_t ring_entries;				/* Size of ring, in entries. */
 	struct file *running_file;			/* file that runs currently */
 	
 	struct process_data_bank *data_bank;	/* process important information store */
 	struct list child_list;
-
-	/* Implement dup2 part: Extended File Descirptor(Extra) -----------------------*/
-	struct list stdin_list;
-	struct list stdout_list;
-	/* Implement dup2 part: Extended File Descirptor(Extra) -----------------------*/
-
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
@@ -139,7 +148,6 @@ struct thread {
 #endif
 #ifdef EFILESYS
 	struct dir *cwd;					/* current working directory */
-	struct list dir_list;				/* hold directory_desc as element */
 #endif
 	
 	/* Owned by thread.c. */
@@ -147,25 +155,6 @@ struct thread {
 	unsigned magic;                     /* Detects stack overflow. */
 };
 
-/* fd of thread */
-struct fd_t{
-	struct file *file;
-	struct list dup2_list;
-	struct list_elem elem;
-};
-
-struct fd{
-	int fd;
-	struct list_elem elem;
-};
-
-struct dir_desc
-{
-	int fd;
-	struct dir *dir;
-	struct list_elem elem;
-};
-
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
@@ -174,7 +163,7 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (const struct intr_frame *);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -217,10 +206,9 @@ void thread_calculate_load_avg(void);
 void thread_recalculate_recent_cpu(void);
 void thread_recalculate_priority(void);
 
-//void priority_donate(struct thread *thread);
 void priority_donate(struct thread *thread);
 
 void priority_update(struct thread *thread);
-void update_donor_lock(struct lock *lock);
+void thread_requeue(struct thread *thread);
 
 #endif /* threads/thread.h */
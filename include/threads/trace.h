@@ -0,0 +1,20 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdint.h>
+
+/* Kinds of trace events. */
+enum trace_type {
+	TRACE_SWITCH,               /* Context switch: A = next tid, B = old status. */
+	TRACE_WAKEUP,               /* Thread unblocked: A = woken tid. */
+	TRACE_CONTEND,              /* Lock contended: A = lock, B = holder tid. */
+	TRACE_FAULT,                /* Page fault: A = address, B = error code. */
+	TRACE_SYSCALL,              /* System call: A = number. */
+	TRACE_TYPE_CNT
+};
+
+void trace_init (void);
+void trace_record (enum trace_type, int tid, uint64_t a, uint64_t b);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
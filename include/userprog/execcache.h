@@ -0,0 +1,40 @@
+#ifndef USERPROG_EXECCACHE_H
+#define USERPROG_EXECCACHE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/disk.h"
+
+struct inode;
+
+/* A loadable segment of an executable, laid out as load_segment()
+   takes it. */
+struct exec_segment {
+	uint64_t file_page;         /* File offset of the first page. */
+	uint64_t mem_page;          /* User address of the first page. */
+	uint32_t read_bytes;        /* Bytes to read from the file. */
+	uint32_t zero_bytes;        /* Bytes to zero after them. */
+	bool writable;
+};
+
+/* What load() learns from an executable's headers once they have
+   been read and validated. */
+struct exec_image {
+	disk_sector_t inumber;      /* Inode the image was read from. */
+	uint64_t entry;             /* Entry point. */
+	int refcnt;                 /* Cache's reference plus users'. */
+	struct list_elem elem;      /* Element in the cache's list. */
+	int seg_cnt;                /* Number of elements in SEGS. */
+	struct exec_segment segs[];
+};
+
+void exec_cache_init (void);
+
+struct exec_image *exec_image_create (disk_sector_t inumber, int seg_cnt);
+void exec_image_put (struct exec_image *);
+
+struct exec_image *exec_cache_lookup (struct inode *, uint64_t *seq);
+void exec_cache_insert (struct exec_image *, struct inode *, uint64_t seq);
+
+#endif /* userprog/execcache.h */
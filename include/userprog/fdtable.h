@@ -0,0 +1,74 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct file;
+struct dir;
+struct pipe;
+struct spawn_fd;
+
+/* Standard file descriptors. */
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
+/* Lowest fd that open() hands out.  Lower fds are reserved for
+   the console and only appear through dup2(). */
+#define FD_FIRST 3
+
+/* One past the largest fd a process may use. */
+#define FD_MAX 4096
+
+/* What an open file object refers to. */
+enum open_file_type {
+	OPEN_STDIN,                 /* Keyboard. */
+	OPEN_STDOUT,                /* Console. */
+	OPEN_FILE,                  /* Regular file. */
+	OPEN_DIR,                   /* Directory. */
+	OPEN_PIPE_READ,             /* Read end of a pipe. */
+	OPEN_PIPE_WRITE             /* Write end of a pipe. */
+};
+
+/* An open file object.  Every fd that dup2() made from the same
+   open() shares one of these, and so shares its file position. */
+struct open_file {
+	enum open_file_type type;
+	union {
+		struct file *file;      /* OPEN_FILE. */
+		struct dir *dir;        /* OPEN_DIR. */
+		struct pipe *pipe;      /* OPEN_PIPE_READ, OPEN_PIPE_WRITE. */
+	};
+	int refcnt;                 /* Number of fds referring to it. */
+
+	/* Used by fd_table_copy(). */
+	struct open_file *copy;     /* Copy made by the fork COPY_SEQ. */
+	uint64_t copy_seq;
+};
+
+/* A process's file descriptor table, indexed directly by fd. */
+struct fd_table {
+	struct open_file **fds;     /* FDS[fd], or NULL if fd is free. */
+	int size;                   /* Number of elements in FDS. */
+	int lowest_free;            /* Every fd below this is in use. */
+};
+
+void fdtable_init (void);
+
+void fd_table_init (struct fd_table *);
+bool fd_table_init_stdio (struct fd_table *);
+bool fd_table_copy (struct fd_table *dst, const struct fd_table *src);
+bool fd_table_inherit (struct fd_table *dst, const struct fd_table *src,
+		const struct spawn_fd *, int cnt);
+void fd_table_destroy (struct fd_table *);
+
+int fd_open (struct fd_table *, enum open_file_type, void *object);
+struct open_file *fd_get (const struct fd_table *, int fd);
+struct file *fd_get_file (const struct fd_table *, int fd);
+struct dir *fd_get_dir (const struct fd_table *, int fd);
+struct pipe *fd_get_pipe (const struct fd_table *, int fd, bool write);
+bool fd_close (struct fd_table *, int fd);
+int fd_dup2 (struct fd_table *, int oldfd, int newfd);
+
+#endif /* userprog/fdtable.h */
@@ -0,0 +1,18 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct pipe;
+
+void pipe_init (void);
+
+struct pipe *pipe_create (void);
+void pipe_open_end (struct pipe *, bool write);
+void pipe_close_end (struct pipe *, bool write);
+
+int pipe_read (struct pipe *, void *udst, size_t size);
+int pipe_write (struct pipe *, const void *usrc, size_t size);
+
+#endif /* userprog/pipe.h */
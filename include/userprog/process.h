@@ -4,6 +4,8 @@
 #include "threads/thread.h"
 #include "threads/synch.h"
 
+struct spawn_fd;
+
 struct process_data_bank {
     
     tid_t tid;
@@ -16,9 +18,14 @@ struct process_data_bank {
 	struct thread *parent;
 	struct intr_frame *parent_if;
 
+    /* information to use in spawn */
+	const struct spawn_fd *spawn_fds;
+	int spawn_fd_cnt;
+
     /* process state information mark */
 	bool init_mark;
 	bool fork_succ;
+	bool spawn_mark;
 	bool exit_mark;
 	bool wait_mark;
     bool orphan;
@@ -33,6 +40,8 @@ struct process_data_bank {
 
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
+tid_t process_spawn (const char *cmdline, const struct spawn_fd *fds,
+		int fd_cnt);
 int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
@@ -1,20 +1,14 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <iovec.h>
+#include <ring.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include "threads/thread.h"
 #include "threads/interrupt.h"
 #include "filesys/file.h"
 
-int insert_file2list(struct file *file, struct thread *thread);
-int insert_dir2list(struct dir *dir, struct thread *curr);
-struct fd *search_fd_single_list(int fd, struct list *list);
-struct fd *search_fd_double_list(int fd, struct list *list);
-struct fd_t *search_fd_t_double_list(int fd, struct list *list);
-struct dir_desc *search_dir_list(int fd, struct list *list);
-
-bool stdio_init(struct thread *t);
-
 void syscall_init (void);
 
 /* Projects 2 and later. ------------------------------------*/
@@ -46,5 +40,27 @@ int sys_dup2(int oldfd, int newfd);
 void *sys_mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void sys_munmap(void *addr);
 
+/* Kernel diagnostics ---------------------------------------*/
+int sys_getrusage(struct rusage *usage);
+
+/* Vectored and positional I/O ------------------------------*/
+int sys_readv(int fd, const struct iovec *iov, int iovcnt);
+int sys_writev(int fd, const struct iovec *iov, int iovcnt);
+int sys_pread(int fd, void *buffer, unsigned length, off_t offset);
+int sys_pwrite(int fd, const void *buffer, unsigned length, off_t offset);
+
+/* Batched system calls -------------------------------------*/
+int sys_ring_setup(struct ring *ring, unsigned entries);
+int sys_ring_enter(unsigned to_submit);
+
+/* Process creation -----------------------------------------*/
+tid_t sys_spawn(const char *cmdline, const struct spawn_fd *fds, int fd_cnt);
+
+/* Interprocess communication -------------------------------*/
+int sys_pipe(int *fds);
+
+/* Shared memory --------------------------------------------*/
+void *sys_mmap_shared(void *addr, size_t length, int writable);
+
 
 #endif /* userprog/syscall.h */
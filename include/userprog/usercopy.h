@@ -0,0 +1,23 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Returns true if the SIZE bytes at UADDR lie entirely in user
+   virtual address space.  Says nothing about whether they are
+   mapped: the routines below find that out by trying. */
+static inline bool
+is_user_range (const void *uaddr, size_t size) {
+	uintptr_t start = (uintptr_t) uaddr;
+	return start + size >= start && start + size <= KERN_BASE;
+}
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+long strncpy_from_user (char *dst, const char *usrc, size_t size);
+long strnlen_user (const char *usrc, size_t size);
+
+#endif /* userprog/usercopy.h */
@@ -12,4 +12,8 @@ struct anon_page {
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
 
+size_t swap_write (const void *kva);
+void swap_read (size_t slot, void *kva);
+void swap_free (size_t slot);
+
 #endif
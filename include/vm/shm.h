@@ -0,0 +1,24 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <list.h>
+#include <stdint.h>
+#include "vm/vm.h"
+
+struct page;
+enum vm_type;
+struct shm_slot;
+
+/* A process's page of a shared anonymous region. */
+struct shm_page {
+	struct shm_slot *slot;      /* Page of the region it maps. */
+	uint64_t *pml4;             /* Address space it belongs to. */
+	struct list_elem elem;      /* Element in SLOT's list of pages. */
+};
+
+bool shm_initializer (struct page *page, enum vm_type type, void *kva);
+bool shm_claim_page (struct page *page);
+void shm_uninit_destroy (void *aux);
+bool shm_fork_page (struct page *parent);
+void *shm_mmap (void *addr, size_t length, bool writable);
+void shm_munmap (void *addr);
+#endif
@@ -14,13 +14,16 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* page of a shared anonymous region */
+	VM_SHARED = 4,
 
 	/* Bit flags to store state */
 
 	/* Auxillary bit flag marker for store information. You can add more
 	 * markers, until the value is fit in the int. */
 	VM_STACK = (1 << 3),
-	VM_MARKER_1 = (1 << 4),
+	/* Uninit page whose aux is a struct segment. */
+	VM_SEGMENT = (1 << 4),
 
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
@@ -29,6 +32,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/shm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -58,6 +62,7 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
+		struct shm_page shm;
 #ifdef EFILESYS
 		struct page_cache page_cache;
 #endif
@@ -74,14 +79,39 @@ struct loading_datas
 	int total_length;
 };
 
+/* A loadable segment of an executable.  Every page of the segment
+ * that has yet to be loaded holds a reference to it, so the whole
+ * segment costs one descriptor and one open file. */
+struct segment
+{
+	struct file *file;     /* Executable, or NULL if nothing to read. */
+	off_t ofs;             /* File offset of the first page. */
+	void *upage;           /* User address of the first page. */
+	size_t read_bytes;     /* Bytes read from FILE; the rest is zero. */
+	int refcnt;            /* References, once shared under frame_lock. */
+};
+
 /* The representation of "frame" */
 struct frame {
 	void *kva;
 	struct page *page;
+	uint64_t *pml4;        /* Page table that maps PAGE to KVA. */
+	int pin_cnt;           /* Neither evicted nor moved while nonzero. */
 
 	struct list_elem elem;
 };
 
+/* Slab caches for frames and loading data, defined in vm.c. */
+extern struct kmem_cache *frame_cachep;
+extern struct kmem_cache *loading_datas_cachep;
+
+/* Guards the frame table and every frame's link to its page. */
+extern struct lock frame_lock;
+
+struct segment *segment_create (struct file *, off_t ofs, void *upage,
+		size_t read_bytes);
+void segment_put (struct segment *);
+
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
  * Put the table of "method" into the struct's member, and
@@ -126,7 +156,10 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+struct frame *vm_get_frame (void);
 bool vm_alloc_and_claim_page (enum vm_type type, void *upage, bool writable);
+bool vm_pin_buffer (const void *uaddr, size_t size, bool write);
+void vm_unpin_buffer (const void *uaddr, size_t size);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
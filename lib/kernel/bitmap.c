@@ -26,6 +26,7 @@ typedef unsigned long elem_type;
    simulates an array of bits. */
 struct bitmap {
 	size_t bit_cnt;     /* Number of bits. */
+	size_t free_hint;   /* No bit below this index is false. */
 	elem_type *bits;    /* Elements that represent bits. */
 };
 
@@ -55,6 +56,26 @@ byte_cnt (size_t bit_cnt) {
 	return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns an elem_type in which bits BIT_IDX % ELEM_BITS up to
+   but not including BIT_IDX % ELEM_BITS + CNT are turned on.
+   The range must lie within one element and CNT must be
+   nonzero. */
+static inline elem_type
+range_mask (size_t bit_idx, size_t cnt) {
+	elem_type ones = cnt >= ELEM_BITS
+		? (elem_type) -1 : ((elem_type) 1 << cnt) - 1;
+	return ones << (bit_idx % ELEM_BITS);
+}
+
+/* Returns the number of bits set in X. */
+static inline size_t
+popcount (elem_type x) {
+	x = x - ((x >> 1) & 0x5555555555555555UL);
+	x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (x * 0x0101010101010101UL) >> 56;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -74,6 +95,7 @@ bitmap_create (size_t bit_cnt) {
 	struct bitmap *b = malloc (sizeof *b);
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
+		b->free_hint = 0;
 		b->bits = malloc (byte_cnt (bit_cnt));
 		if (b->bits != NULL || bit_cnt == 0) {
 			bitmap_set_all (b, false);
@@ -94,6 +116,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
 	ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
 	b->bit_cnt = bit_cnt;
+	b->free_hint = 0;
 	b->bits = (elem_type *) (b + 1);
 	bitmap_set_all (b, false);
 	return b;
@@ -160,6 +183,8 @@ bitmap_reset (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the AND instruction in [IA32-v2a]. */
 	asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+	if (bit_idx < b->free_hint)
+		b->free_hint = bit_idx;
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -174,6 +199,8 @@ bitmap_flip (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the XOR instruction in [IA32-v2b]. */
 	asm ("lock xorq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	if (bit_idx < b->free_hint)
+		b->free_hint = bit_idx;
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -197,47 +224,87 @@ bitmap_set_all (struct bitmap *b, bool value) {
 /* Sets the CNT bits starting at START in B to VALUE. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
+	size_t end = start + cnt;
 	size_t i;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	/* One whole or partial element at a time, each updated
+	   atomically as in bitmap_mark() and bitmap_reset(). */
+	for (i = start; i < end; ) {
+		size_t idx = elem_idx (i);
+		size_t chunk = ELEM_BITS - i % ELEM_BITS;
+		elem_type mask;
+
+		if (chunk > end - i)
+			chunk = end - i;
+		mask = range_mask (i, chunk);
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+		i += chunk;
+	}
+	if (!value && cnt > 0 && start < b->free_hint)
+		b->free_hint = start;
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t value_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
 	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	while (start < end) {
+		size_t chunk = ELEM_BITS - start % ELEM_BITS;
+		if (chunk > end - start)
+			chunk = end - start;
+		value_cnt += popcount (b->bits[elem_idx (start)]
+				& range_mask (start, chunk));
+		start += chunk;
+	}
+	return value ? value_cnt : cnt - value_cnt;
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Examines a whole element per step, so runs of bits that differ
+   from VALUE are skipped ELEM_BITS at a time. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) {
+	while (start < end) {
+		size_t chunk = ELEM_BITS - start % ELEM_BITS;
+		elem_type bits = b->bits[elem_idx (start)];
+
+		if (chunk > end - start)
+			chunk = end - start;
+		if (!value)
+			bits = ~bits;
+		bits &= range_mask (start, chunk);
+		if (bits != 0)
+			return start - start % ELEM_BITS + __builtin_ctzl (bits);
+		start += chunk;
+	}
+	return end;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_bit (b, start, start + cnt, value) != start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -260,26 +327,52 @@ bool
 bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 	return !bitmap_contains (b, start, cnt, false);
 }
-
+
 /* Finding set or unset bits. */
 
+/* Does the work of bitmap_scan().  Also stores in *FIRST the
+   index of the first bit at or after the search start that is set
+   to VALUE, or the bitmap size if there is none. */
+static size_t
+scan (const struct bitmap *b, size_t start, size_t cnt, bool value,
+		size_t *first) {
+	size_t i;
+
+	if (cnt == 0) {
+		*first = start;
+		return start;
+	}
+
+	/* No false bits lie below the hint. */
+	if (!value && start < b->free_hint)
+		start = b->free_hint;
+
+	*first = i = find_bit (b, start, b->bit_cnt, value);
+	while (i < b->bit_cnt && cnt <= b->bit_cnt - i) {
+		/* I starts a run of VALUE bits.  See whether it is long
+		   enough, and if not resume after the bit that ends it. */
+		size_t stop = find_bit (b, i, i + cnt, !value);
+		if (stop == i + cnt)
+			return i;
+		i = find_bit (b, stop, b->bit_cnt, value);
+	}
+	return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
    If there is no such group, returns BITMAP_ERROR. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
+	size_t first;
+
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
-	}
-	return BITMAP_ERROR;
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+	return scan (b, start, cnt, value, &first);
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -291,12 +384,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    setting them. */
 size_t
 bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t idx = bitmap_scan (b, start, cnt, value);
-	if (idx != BITMAP_ERROR)
+	size_t first;
+	size_t idx;
+
+	ASSERT (b != NULL);
+	ASSERT (start <= b->bit_cnt);
+
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+	idx = scan (b, start, cnt, value, &first);
+
+	/* Searching from the hint found the first false bit, which
+	   moves past the group if the group starts there. */
+	if (!value && start <= b->free_hint)
+		b->free_hint = first;
+	if (idx != BITMAP_ERROR) {
 		bitmap_set_multiple (b, idx, cnt, !value);
+		if (!value && idx == b->free_hint)
+			b->free_hint = idx + cnt;
+	}
 	return idx;
 }
-
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -315,6 +424,7 @@ bitmap_read (struct bitmap *b, struct file *file) {
 		off_t size = byte_cnt (b->bit_cnt);
 		success = file_read_at (file, b->bits, size, 0) == size;
 		b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+		b->free_hint = 0;
 	}
 	return success;
 }
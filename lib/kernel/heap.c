@@ -0,0 +1,195 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a heap-ordered multiway tree.  Each node
+   points to its leftmost child and to its right sibling, so the
+   children of a node form a singly linked list.  The `prev'
+   link points to the left sibling, or to the parent for the
+   leftmost child, which lets any element be cut out of the tree
+   in O(1) for heap_remove() and heap_update().
+
+   Melding two trees makes the root with the smaller key the
+   leftmost child of the other root.  Removing the root melds
+   its children back together in two passes: first left to right
+   in pairs, then the resulting trees right to left.  This
+   "two-pass" merge is what gives the O(log n) amortized bound.
+
+   Both passes are iterative, since kernel stacks are small. */
+
+/* Returns true if A belongs above B in heap H: that is, if A is
+   greater than B, or they are equal and A was inserted first. */
+static inline bool
+heap_above (const struct heap *h, const struct heap_elem *a,
+		const struct heap_elem *b) {
+	if (h->less (b, a, h->aux))
+		return true;
+	if (h->less (a, b, h->aux))
+		return false;
+	return a->seq < b->seq;
+}
+
+/* Melds the trees rooted at A and B, either of which may be
+   null, and returns the root of the result.  A and B must not
+   have siblings or parents. */
+static struct heap_elem *
+meld (const struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (heap_above (h, b, a)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	b->prev = a;
+	b->sibling = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Melds the sibling list that starts at FIRST into a single tree
+   and returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (const struct heap *h, struct heap_elem *first) {
+	struct heap_elem *stack = NULL;
+	struct heap_elem *root = NULL;
+
+	/* First pass: meld adjacent pairs from left to right,
+	   pushing each result onto STACK. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->sibling;
+		struct heap_elem *m;
+
+		first = b != NULL ? b->sibling : NULL;
+		a->sibling = a->prev = NULL;
+		if (b != NULL)
+			b->sibling = b->prev = NULL;
+		m = meld (h, a, b);
+		m->sibling = stack;
+		stack = m;
+	}
+
+	/* Second pass: meld the pairs from right to left. */
+	while (stack != NULL) {
+		struct heap_elem *next = stack->sibling;
+		stack->sibling = NULL;
+		root = meld (h, root, stack);
+		stack = next;
+	}
+	return root;
+}
+
+/* Cuts the subtree rooted at E, which must not be the root of
+   its heap, out of the tree it belongs to. */
+static void
+detach (struct heap_elem *e) {
+	if (e->prev->child == e)
+		e->prev->child = e->sibling;
+	else
+		e->prev->sibling = e->sibling;
+	if (e->sibling != NULL)
+		e->sibling->prev = e->prev;
+	e->sibling = e->prev = NULL;
+}
+
+/* Removes E from the tree structure of H without changing the
+   element count, leaving E as a lone node. */
+static void
+extract (struct heap *h, struct heap_elem *e) {
+	struct heap_elem *children;
+
+	if (e == h->root) {
+		h->root = merge_pairs (h, e->child);
+		e->child = NULL;
+		return;
+	}
+
+	detach (e);
+	children = merge_pairs (h, e->child);
+	e->child = NULL;
+	h->root = meld (h, h->root, children);
+}
+
+/* Initializes H as an empty heap ordered by LESS given auxiliary
+   data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->next_seq = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->sibling = e->prev = NULL;
+	e->seq = h->next_seq++;
+	h->root = meld (h, h->root, e);
+	h->elem_cnt++;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+	ASSERT (h->elem_cnt > 0);
+
+	extract (h, e);
+	h->elem_cnt--;
+}
+
+/* Restores the heap property after the key of E, which must be
+   in H, has changed.  E keeps its place among equal elements. */
+void
+heap_update (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	extract (h, e);
+	h->root = meld (h, h->root, e);
+}
+
+/* Returns the greatest element in H.  Undefined behavior if H is
+   empty. */
+struct heap_elem *
+heap_max (struct heap *h) {
+	ASSERT (!heap_empty (h));
+	return h->root;
+}
+
+/* Removes the greatest element from H and returns it.  Undefined
+   behavior if H is empty. */
+struct heap_elem *
+heap_pop_max (struct heap *h) {
+	struct heap_elem *max = heap_max (h);
+	heap_remove (h, max);
+	return max;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (struct heap *h) {
+	ASSERT (h != NULL);
+	return h->elem_cnt;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (struct heap *h) {
+	ASSERT (h != NULL);
+	return h->root == NULL;
+}
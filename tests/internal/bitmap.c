@@ -0,0 +1,129 @@
+/* Microbenchmark for lib/kernel/bitmap.c.
+
+   Compares bitmap_scan() against the original bit-at-a-time
+   scan, which tested every candidate start bit with
+   bitmap_contains() over bitmap_test(), on large bitmaps with a
+   few different fill patterns.  Checks that both scans agree and
+   prints the time stamp counter cycles each one took.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Number of bits in each bitmap we will test. */
+#define BIT_CNT (1024 * 1024)
+
+/* Number of scans timed per pattern. */
+#define SCAN_CNT 4
+
+static size_t old_scan (const struct bitmap *, size_t start, size_t cnt,
+                        bool value);
+static void fill_pattern (struct bitmap *, int pattern);
+static void compare_scans (struct bitmap *, const char *name, size_t cnt);
+
+/* Run the benchmark. */
+void
+test (void)
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  ASSERT (b != NULL);
+
+  fill_pattern (b, 0);
+  compare_scans (b, "free run at the end", 1);
+  fill_pattern (b, 0);
+  compare_scans (b, "free run at the end", 64);
+
+  fill_pattern (b, 1);
+  compare_scans (b, "sparse single free bits", 1);
+  fill_pattern (b, 1);
+  compare_scans (b, "sparse single free bits", 8);
+
+  fill_pattern (b, 2);
+  compare_scans (b, "random half full", 16);
+
+  bitmap_destroy (b);
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets up B for a benchmark.  Pattern 0 marks everything used
+   except the last 256 bits, pattern 1 additionally leaves every
+   1000th bit free, and pattern 2 sets each bit at random. */
+static void
+fill_pattern (struct bitmap *b, int pattern)
+{
+  size_t i;
+
+  bitmap_set_all (b, true);
+  if (pattern == 0 || pattern == 1)
+    bitmap_set_multiple (b, BIT_CNT - 256, 256, false);
+  if (pattern == 1)
+    for (i = 0; i < BIT_CNT - 256; i += 1000)
+      bitmap_reset (b, i);
+  if (pattern == 2)
+    for (i = 0; i < BIT_CNT; i++)
+      bitmap_set (b, i, random_ulong () % 2);
+}
+
+/* Times SCAN_CNT searches for CNT false bits in B with the old and
+   the new scan, and prints the results under NAME.  Each found
+   group is marked used before the next search, as palloc and the
+   swap table do. */
+static void
+compare_scans (struct bitmap *b, const char *name, size_t cnt)
+{
+  uint64_t old_cycles = 0, new_cycles = 0;
+  int i;
+
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      uint64_t start;
+      size_t old_idx, new_idx;
+
+      start = rdtsc ();
+      old_idx = old_scan (b, 0, cnt, false);
+      old_cycles += rdtsc () - start;
+
+      start = rdtsc ();
+      new_idx = bitmap_scan (b, 0, cnt, false);
+      new_cycles += rdtsc () - start;
+
+      ASSERT (old_idx == new_idx);
+      if (new_idx != BITMAP_ERROR)
+        bitmap_set_multiple (b, new_idx, cnt, true);
+    }
+
+  printf ("%s, %zu bits: old %llu cycles, new %llu cycles\n",
+          name, cnt, old_cycles / SCAN_CNT, new_cycles / SCAN_CNT);
+}
+
+/* The original bitmap_scan(): tries every start bit in turn and
+   tests each candidate group one bit at a time. */
+static size_t
+old_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+
+  if (cnt <= bit_cnt)
+    {
+      size_t last = bit_cnt - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
@@ -0,0 +1,130 @@
+/* Test program for lib/kernel/heap.c.
+
+   Inserts shuffled values into heaps of various sizes, removes
+   and re-keys random elements, and checks that heap_pop_max()
+   returns them in nonincreasing order with ties in insertion
+   order.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 64
+
+/* A heap element. */
+struct value
+  {
+    struct heap_elem elem;      /* Heap element. */
+    int value;                  /* Item value. */
+    bool in_heap;               /* Currently in the heap? */
+  };
+
+static bool value_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void verify_heap (struct heap *, struct value[], int size);
+
+/* Test the heap implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size heaps:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          static struct value values[MAX_SIZE];
+          struct heap heap;
+          int i;
+
+          /* Insert SIZE values, with plenty of duplicates. */
+          heap_init (&heap, value_less, NULL);
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = random_ulong () % 8;
+              values[i].in_heap = true;
+              heap_insert (&heap, &values[i].elem);
+            }
+          ASSERT (heap_size (&heap) == (size_t) size);
+
+          /* Remove or re-key random elements. */
+          for (i = 0; i < size; i++)
+            {
+              struct value *v = &values[random_ulong () % size];
+              if (!v->in_heap)
+                continue;
+              if (random_ulong () % 2)
+                {
+                  heap_remove (&heap, &v->elem);
+                  v->in_heap = false;
+                }
+              else
+                {
+                  v->value = random_ulong () % 8;
+                  heap_update (&heap, &v->elem);
+                }
+            }
+
+          verify_heap (&heap, values, size);
+        }
+    }
+
+  printf (" done\n");
+  printf ("heap: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = heap_entry (a_, struct value, elem);
+  const struct value *b = heap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Verifies that HEAP holds exactly the elements of VALUES[0...SIZE]
+   still marked in_heap, and that popping them yields nonincreasing
+   values with equal values in insertion order. */
+static void
+verify_heap (struct heap *heap, struct value values[], int size)
+{
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < size; i++)
+    if (values[i].in_heap)
+      cnt++;
+  ASSERT (heap_size (heap) == (size_t) cnt);
+
+  while (!heap_empty (heap))
+    {
+      struct value *v = heap_entry (heap_pop_max (heap), struct value, elem);
+      ASSERT (v->in_heap);
+      v->in_heap = false;
+      cnt--;
+
+      if (!heap_empty (heap))
+        {
+          struct value *next = heap_entry (heap_max (heap),
+                                           struct value, elem);
+          ASSERT (next->value <= v->value);
+          ASSERT (next->value < v->value || next->elem.seq > v->elem.seq);
+        }
+    }
+  ASSERT (cnt == 0);
+}
@@ -0,0 +1,80 @@
+/* Streams data from a child to its parent through a pipe, once in
+   small writes that go through the pipe's ring buffer and once in
+   large writes that readers copy straight out of the writer's
+   buffer.  Checks that every byte arrives intact and in order, and
+   reports the CPU time the reader spent on each run. */
+
+#include <rusage.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Bytes sent by each run. */
+#define TOTAL (2 * 1024 * 1024)
+
+static char buf[64 * 1024];
+
+/* Returns the byte expected at offset OFS of the stream. */
+static char
+pattern (size_t ofs)
+{
+  return (char) (ofs * 31 + ofs / 4096);
+}
+
+static void
+run (const char *name, size_t chunk)
+{
+  struct rusage before, after;
+  size_t received = 0;
+  int fds[2];
+  pid_t child;
+  int n;
+
+  CHECK (pipe (fds) == 0, "pipe() for %s writes", name);
+  child = fork ("writer");
+  if (child == 0)
+    {
+      size_t sent, i;
+
+      close (fds[0]);
+      for (sent = 0; sent < TOTAL; sent += chunk)
+        {
+          for (i = 0; i < chunk; i++)
+            buf[i] = pattern (sent + i);
+          if (write (fds[1], buf, chunk) != (int) chunk)
+            exit (1);
+        }
+      exit (0);
+    }
+  CHECK (child > 0, "fork writer for %s writes", name);
+  close (fds[1]);
+
+  getrusage (&before);
+  while ((n = read (fds[0], buf, sizeof buf)) > 0)
+    {
+      int i;
+
+      for (i = 0; i < n; i++)
+        if (buf[i] != pattern (received + i))
+          fail ("byte %zu differs from what was written", received + i);
+      received += n;
+    }
+  getrusage (&after);
+  close (fds[0]);
+
+  if (received != TOTAL)
+    fail ("received %zu bytes instead of %d", received, TOTAL);
+  CHECK (wait (child) == 0, "wait for writer");
+  msg ("%s writes: %d bytes intact", name, TOTAL);
+  printf ("pipe-bench: %s writes: %lld ticks\n", name,
+          (long long) (after.user_ticks + after.kernel_ticks
+                       - before.user_ticks - before.kernel_ticks));
+}
+
+void
+test_main (void)
+{
+  run ("small", 256);
+  run ("large", sizeof buf);
+}
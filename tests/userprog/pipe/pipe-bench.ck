@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = grep (!/^pipe-bench: .* ticks$/, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(pipe-bench) begin
+(pipe-bench) pipe() for small writes
+(pipe-bench) fork writer for small writes
+(pipe-bench) wait for writer
+(pipe-bench) small writes: 2097152 bytes intact
+(pipe-bench) pipe() for large writes
+(pipe-bench) fork writer for large writes
+(pipe-bench) wait for writer
+(pipe-bench) large writes: 2097152 bytes intact
+(pipe-bench) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Registers a ring whose header sits at the very top of the stack,
+   so that its queues lie in the unmapped page above, and queues a
+   request there.  ring_enter() must terminate the process with
+   exit code -1 rather than fault in the kernel. */
+
+#include <ring.h>
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char top;
+  struct ring *ring = (struct ring *) (ROUND_UP ((uintptr_t) &top, 4096)
+                                       - sizeof *ring);
+
+  /* The header overwrites the command line, which TEST_NAME
+     points into. */
+  test_name = "ring-bad-queue";
+  CHECK (ring_setup (ring, 8) == 0, "ring_setup at the top of the stack");
+
+  /* Skip the first entry, which begins exactly at the top of the
+     stack, where a fault might be taken for stack growth. */
+  ring->sq_head = 1;
+  ring->sq_tail = 2;
+  ring_enter (1);
+  fail ("should have exited with -1");
+}
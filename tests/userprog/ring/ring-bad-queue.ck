@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-bad-queue) begin
+(ring-bad-queue) ring_setup at the top of the stack
+ring-bad-queue: exit(-1)
+EOF
+pass;
@@ -0,0 +1,87 @@
+/* Runs requests through a system call ring: opens, reads and
+   closes a file, checks that results come back tagged with their
+   user_data, and that the kernel stops taking requests while the
+   completion queue is full. */
+
+#include <ring.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 8
+
+static uint64_t ring_mem[RING_BYTES (ENTRIES) / sizeof (uint64_t)];
+
+/* Queues a request on RING. */
+static void
+submit (struct ring *ring, enum ring_op op, int fd, void *addr,
+        uint32_t len, int32_t off, uint64_t user_data)
+{
+  struct ring_sqe *sqe = &ring_sq (ring)[ring->sq_tail % ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t) addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+}
+
+/* Takes the next completion from RING, which must have one, and
+   checks its tag. */
+static int64_t
+reap (struct ring *ring, uint64_t user_data)
+{
+  struct ring_cqe *cqe;
+
+  if (ring->cq_head == ring->cq_tail)
+    fail ("no completion for request %llu", user_data);
+  cqe = &ring_cq (ring, ENTRIES)[ring->cq_head % ENTRIES];
+  if (cqe->user_data != user_data)
+    fail ("completion tagged %llu instead of %llu",
+          cqe->user_data, user_data);
+  ring->cq_head++;
+  return cqe->res;
+}
+
+void
+test_main (void) 
+{
+  struct ring *ring = (struct ring *) ring_mem;
+  char head[20], middle[50];
+  int handle, i;
+
+  CHECK (ring_enter (1) == -1, "ring_enter without a ring fails");
+  CHECK (ring_setup (ring, 6) == -1, "ring_setup with 6 entries fails");
+  CHECK (ring_setup (ring, ENTRIES) == 0, "ring_setup");
+
+  submit (ring, RING_OPEN, 0, "sample.txt", 0, 0, 1);
+  submit (ring, RING_NOP, 0, NULL, 0, 0, 2);
+  submit (ring, 99, 0, NULL, 0, 0, 3);
+  CHECK (ring_enter (3) == 3, "ring_enter runs open, nop and a bad op");
+  CHECK ((handle = reap (ring, 1)) > 1, "open \"sample.txt\"");
+  CHECK (reap (ring, 2) == 0, "nop returns 0");
+  CHECK (reap (ring, 3) == -1, "bad op returns -1");
+
+  submit (ring, RING_PREAD, handle, middle, sizeof middle, 100, 4);
+  submit (ring, RING_READ, handle, head, sizeof head, 0, 5);
+  submit (ring, RING_CLOSE, handle, NULL, 0, 0, 6);
+  CHECK (ring_enter (3) == 3, "ring_enter runs pread, read and close");
+  CHECK (reap (ring, 4) == sizeof middle, "pread \"sample.txt\"");
+  compare_bytes (middle, sample + 100, sizeof middle, 100, "sample.txt");
+  CHECK (reap (ring, 5) == sizeof head, "read \"sample.txt\"");
+  compare_bytes (head, sample, sizeof head, 0, "sample.txt");
+  CHECK (reap (ring, 6) == 0, "close \"sample.txt\"");
+
+  for (i = 0; i < ENTRIES; i++)
+    submit (ring, RING_NOP, 0, NULL, 0, 0, 10 + i);
+  CHECK (ring_enter (ENTRIES) == ENTRIES, "ring_enter fills the completions");
+  submit (ring, RING_NOP, 0, NULL, 0, 0, 10 + ENTRIES);
+  CHECK (ring_enter (1) == 0, "ring_enter stops while they are full");
+  reap (ring, 10);
+  CHECK (ring_enter (1) == 1, "ring_enter resumes once one is reaped");
+  for (i = 1; i <= ENTRIES; i++)
+    reap (ring, 10 + i);
+}
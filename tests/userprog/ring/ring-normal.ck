@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-normal) begin
+(ring-normal) ring_enter without a ring fails
+(ring-normal) ring_setup with 6 entries fails
+(ring-normal) ring_setup
+(ring-normal) ring_enter runs open, nop and a bad op
+(ring-normal) open "sample.txt"
+(ring-normal) nop returns 0
+(ring-normal) bad op returns -1
+(ring-normal) ring_enter runs pread, read and close
+(ring-normal) pread "sample.txt"
+(ring-normal) read "sample.txt"
+(ring-normal) close "sample.txt"
+(ring-normal) ring_enter fills the completions
+(ring-normal) ring_enter stops while they are full
+(ring-normal) ring_enter resumes once one is reaped
+(ring-normal) end
+ring-normal: exit(0)
+EOF
+pass;
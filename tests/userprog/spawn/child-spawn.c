@@ -0,0 +1,31 @@
+/* Child process run by spawn-fds test.
+
+   Expects fds 3 and 4 to be independent copies of "sample.txt"
+   and fd 5 to be closed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+
+const char *test_name = "child-spawn";
+
+int
+main (void) 
+{
+  char buf[20];
+
+  msg ("begin");
+
+  check_file_handle (3, "sample.txt", sample, sizeof sample - 1);
+
+  CHECK (read (4, buf, sizeof buf) == sizeof buf,
+         "read fd 4 first %zu bytes", sizeof buf);
+  if (memcmp (buf, sample, sizeof buf))
+    fail ("fd 4 does not start at offset 0");
+
+  CHECK (read (5, buf, sizeof buf) == -1, "read closed fd 5");
+
+  msg ("end");
+  return 0;
+}
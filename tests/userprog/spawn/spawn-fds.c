@@ -0,0 +1,33 @@
+/* Spawns a child that gets two copies of an open file and a
+   descriptor that is closed again, and checks that the child
+   sees exactly that, without disturbing the parent's file
+   position.  Also checks that spawning with a descriptor the
+   parent does not have open fails. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  struct spawn_fd fds[] = {
+    { handle, 3 },
+    { handle, 4 },
+    { handle, 5 },
+    { -1, 5 },
+  };
+  msg ("wait(spawn()) = %d",
+       wait (spawn ("child-spawn", fds, sizeof fds / sizeof *fds)));
+
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+
+  struct spawn_fd bad = { 42, 3 };
+  CHECK (spawn ("child-spawn", &bad, 1) == PID_ERROR,
+         "spawn with unopened fd fails");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-fds) begin
+(spawn-fds) open "sample.txt"
+(child-spawn) begin
+(child-spawn) verified contents of "sample.txt"
+(child-spawn) read fd 4 first 20 bytes
+(child-spawn) read closed fd 5
+(child-spawn) end
+child-spawn: exit(0)
+(spawn-fds) wait(spawn()) = 0
+(spawn-fds) verified contents of "sample.txt"
+(spawn-fds) spawn with unopened fd fails
+(spawn-fds) end
+spawn-fds: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Reads the middle of "sample.txt" with pread() and checks that
+   the data is right and that the file position did not move. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OFS 100
+#define LEN 50
+
+void
+test_main (void) 
+{
+  char buf[LEN];
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  byte_cnt = pread (handle, buf, LEN, OFS);
+  if (byte_cnt != LEN)
+    fail ("pread() returned %d instead of %d", byte_cnt, LEN);
+  compare_bytes (buf, sample + OFS, LEN, OFS, "sample.txt");
+  CHECK (tell (handle) == 0, "pread() left the position at 0");
+
+  byte_cnt = pread (handle, buf, LEN, sizeof sample - 1);
+  CHECK (byte_cnt == 0, "pread() at end of file returns 0");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-normal) begin
+(pread-normal) open "sample.txt"
+(pread-normal) pread() left the position at 0
+(pread-normal) pread() at end of file returns 0
+(pread-normal) end
+pread-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Overwrites a file with pwrite(), then extends it with another
+   pwrite() at its end, and checks the contents and that the file
+   position did not move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[400];
+  int handle, byte_cnt;
+
+  memset (expected, 'a', 300);
+  memset (expected + 300, 'b', 100);
+
+  CHECK (create ("test.txt", 300), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = pwrite (handle, expected, 300, 0);
+  if (byte_cnt != 300)
+    fail ("pwrite() returned %d instead of 300", byte_cnt);
+  byte_cnt = pwrite (handle, expected + 300, 100, 300);
+  if (byte_cnt != 100)
+    fail ("pwrite() at end of file returned %d instead of 100", byte_cnt);
+  CHECK (tell (handle) == 0, "pwrite() left the position at 0");
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", expected, sizeof expected);
+}
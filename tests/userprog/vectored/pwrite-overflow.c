@@ -0,0 +1,26 @@
+/* Tries pread() and pwrite() at offsets where OFFSET + LENGTH
+   does not fit in an off_t.  Both must fail without touching the
+   file. */
+
+#include <limits.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[16] = "overflow";
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  CHECK (pwrite (handle, buf, sizeof buf, INT_MAX - 4) == -1,
+         "pwrite() ending past INT_MAX fails");
+  CHECK (pread (handle, buf, sizeof buf, INT_MAX - 4) == -1,
+         "pread() ending past INT_MAX fails");
+  CHECK (pwrite (handle, buf, sizeof buf, -1) == -1,
+         "pwrite() at a negative offset fails");
+  CHECK (filesize (handle) == 0, "file is still empty");
+}
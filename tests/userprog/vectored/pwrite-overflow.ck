@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pwrite-overflow) begin
+(pwrite-overflow) create "test.txt"
+(pwrite-overflow) open "test.txt"
+(pwrite-overflow) pwrite() ending past INT_MAX fails
+(pwrite-overflow) pread() ending past INT_MAX fails
+(pwrite-overflow) pwrite() at a negative offset fails
+(pwrite-overflow) file is still empty
+(pwrite-overflow) end
+pwrite-overflow: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Reads "sample.txt" with one readv() into three buffers, the
+   middle one empty and the last one larger than what is left of
+   the file, and checks that they hold the file in order. */
+
+#include <iovec.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char head[100];
+static char tail[sizeof sample];
+
+void
+test_main (void) 
+{
+  size_t size = sizeof sample - 1;
+  struct iovec iov[3] = {
+    { head, sizeof head },
+    { NULL, 0 },
+    { tail, sizeof tail },
+  };
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("readv() returned %d instead of %zu", byte_cnt, size);
+  compare_bytes (head, sample, sizeof head, 0, "sample.txt");
+  compare_bytes (tail, sample + sizeof head, size - sizeof head,
+                 sizeof head, "sample.txt");
+  CHECK (tell (handle) == size, "readv() advanced the position to the end");
+}
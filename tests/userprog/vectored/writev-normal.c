@@ -0,0 +1,35 @@
+/* Writes a file with one writev() from three buffers, the middle
+   one empty, and checks that the file holds them in order. */
+
+#include <iovec.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char first[] = "Segments written by writev() ";
+static char last[] = "arrive in order, as if by a single write().\n";
+static char expected[] = "Segments written by writev() "
+                         "arrive in order, as if by a single write().\n";
+
+void
+test_main (void) 
+{
+  struct iovec iov[3] = {
+    { first, sizeof first - 1 },
+    { NULL, 0 },
+    { last, sizeof last - 1 },
+  };
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != sizeof expected - 1)
+    fail ("writev() returned %d instead of %zu",
+          byte_cnt, sizeof expected - 1);
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", expected, sizeof expected - 1);
+}
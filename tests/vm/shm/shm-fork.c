@@ -0,0 +1,34 @@
+/* Maps a shared region, forks, and checks that the parent sees
+   what the child wrote to it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ADDR ((char *) 0x10000000)
+#define SIZE (4 * 4096)
+
+void
+test_main (void)
+{
+	const char *msg1 = "written by parent";
+	const char *msg2 = "written by child";
+	char *mem;
+	pid_t child;
+
+	CHECK ((mem = mmap_shared (ADDR, SIZE, 1)) == ADDR, "mmap_shared");
+	strlcpy (mem, msg1, SIZE);
+
+	child = fork ("child");
+	if (child == 0) {
+		CHECK (!strcmp (mem, msg1), "child sees parent's data");
+		strlcpy (mem, msg2, SIZE);
+		strlcpy (mem + SIZE - 4096, msg2, 4096);
+		return;
+	}
+	wait (child);
+	CHECK (!strcmp (mem, msg2), "parent sees child's data");
+	CHECK (!strcmp (mem + SIZE - 4096, msg2),
+	       "parent sees child's data in last page");
+}
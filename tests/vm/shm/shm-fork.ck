@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm-fork) begin
+(shm-fork) mmap_shared
+(shm-fork) child sees parent's data
+(shm-fork) end
+(shm-fork) parent sees child's data
+(shm-fork) parent sees child's data in last page
+(shm-fork) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Maps a shared region twice the size of memory, so that most of
+   its pages are swapped out, and checks that writes from a forked
+   child reach the parent through swap.  Pintos memory size is
+   10MB for this test. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ADDR ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (20 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+void
+test_main (void)
+{
+	char *mem;
+	pid_t child;
+	size_t i;
+
+	CHECK ((mem = mmap_shared (ADDR, CHUNK_SIZE, 1)) == ADDR, "mmap_shared");
+	for (i = 0; i < PAGE_COUNT; i++)
+		mem[i * PAGE_SIZE] = (char) i;
+
+	child = fork ("child");
+	if (child == 0) {
+		for (i = 0; i < PAGE_COUNT; i++) {
+			if (mem[i * PAGE_SIZE] != (char) i)
+				fail ("child sees wrong data in page %zu", i);
+			mem[i * PAGE_SIZE] = (char) ~i;
+		}
+		msg ("child wrote every page");
+		return;
+	}
+	wait (child);
+	for (i = 0; i < PAGE_COUNT; i++)
+		if (mem[i * PAGE_SIZE] != (char) ~i)
+			fail ("parent sees wrong data in page %zu", i);
+	msg ("parent sees child's data in every page");
+}
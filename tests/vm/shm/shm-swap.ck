@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm-swap) begin
+(shm-swap) mmap_shared
+(shm-swap) child wrote every page
+(shm-swap) end
+(shm-swap) parent sees child's data in every page
+(shm-swap) end
+EOF
+pass;
@@ -17,10 +17,14 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtrack.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -54,12 +58,19 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+#ifdef USERPROG
+/* -reap: Free exited processes' page tables in the background? */
+static bool reap_page_tables;
+#endif
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
+static void run_trace (char **argv);
+static void run_memstat (char **argv);
 static void usage (void);
 
 static void print_stats (void);
@@ -98,6 +109,7 @@ main (void) {
 	/* Initialize interrupt handlers. */
 	intr_init ();
 	timer_init ();
+	trace_init ();
 	kbd_init ();
 	input_init ();
 #ifdef USERPROG
@@ -108,6 +120,10 @@ main (void) {
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+#ifdef USERPROG
+	if (reap_page_tables)
+		pml4_reaper_start ();
+#endif
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -149,16 +165,20 @@ bss_init (void) {
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
-	int perm;
+	uint64_t perm, kernel_flags;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
+	/* Kernel mappings are the same in every address space, so mark
+	 * them global if the CPU lets us keep them across CR3 loads. */
+	kernel_flags = mmu_init ();
+
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
 	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
 		uint64_t va = (uint64_t) ptov(pa);
 
-		perm = PTE_P | PTE_W;
+		perm = PTE_P | PTE_W | kernel_flags;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
@@ -229,6 +249,8 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+		else if (!strcmp (name, "-reap"))
+			reap_page_tables = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -255,6 +277,18 @@ run_task (char **argv) {
 	printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Dumps the scheduler trace buffer. */
+static void
+run_trace (char **argv UNUSED) {
+	trace_dump ();
+}
+
+/* Dumps kernel memory usage by allocation call site. */
+static void
+run_memstat (char **argv UNUSED) {
+	memtrack_dump ();
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -269,6 +303,8 @@ run_actions (char **argv) {
 	/* Table of supported actions. */
 	static const struct action actions[] = {
 		{"run", 2, run_task},
+		{"trace", 1, run_trace},
+		{"memstat", 1, run_memstat},
 #ifdef FILESYS
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
@@ -315,6 +351,8 @@ usage (void) {
 #else
 			"  run TEST           Run TEST.\n"
 #endif
+			"  trace              Dump the scheduler trace buffer.\n"
+			"  memstat            Dump kernel memory usage by call site.\n"
 #ifdef FILESYS
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
@@ -331,6 +369,7 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+			"  -reap              Free exited processes' page tables lazily.\n"
 #endif
 			);
 	power_off ();
@@ -357,6 +396,12 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	synch_print_stats ();
+	kmem_print_stats ();
+	malloc_stats ();
+#ifdef MEMTRACK
+	memtrack_dump ();
+#endif
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
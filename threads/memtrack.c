@@ -0,0 +1,227 @@
+#include "threads/memtrack.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Kernel memory accounting by call site.
+
+   malloc(), the page allocator and the slab allocator report
+   every allocation with the address of the code that asked for
+   it, and every free.  Two open-addressed hash tables keep the
+   books: one maps each live block to its size and call site, the
+   other keeps running totals per call site.  Both are fixed
+   arrays, since they must not allocate memory themselves;
+   allocations that do not fit are only counted.
+
+   Call sites are printed as raw addresses.  Pass them to the
+   `backtrace' utility to translate them into function names and
+   line numbers. */
+
+#ifdef MEMTRACK
+
+/* Live block table: 2**BLOCK_BITS slots. */
+#define BLOCK_BITS 13
+#define BLOCK_CNT (1 << BLOCK_BITS)
+
+/* Call site table: 2**SITE_BITS slots. */
+#define SITE_BITS 9
+#define SITE_CNT (1 << SITE_BITS)
+
+/* Number of call sites printed by memtrack_dump(). */
+#define TOP_CNT 20
+
+/* Tables are never filled past 3/4, to keep probes short. */
+#define FULL(CNT) ((CNT) / 4 * 3)
+
+/* A live block. */
+struct block_rec {
+	uintptr_t ptr;              /* Block address, 0 if slot is empty. */
+	uint32_t size;              /* Size in bytes. */
+	uint16_t site;              /* Index in sites[]. */
+};
+
+/* Totals for one call site. */
+struct site_rec {
+	uintptr_t site;             /* Return address, 0 if slot is empty. */
+	size_t live_cnt;            /* Blocks not yet freed. */
+	size_t live_bytes;          /* Bytes not yet freed. */
+	unsigned long long alloc_cnt;   /* Blocks ever allocated. */
+};
+
+static struct block_rec blocks[BLOCK_CNT];
+static struct site_rec sites[SITE_CNT];
+static size_t block_cnt;        /* Slots in use in blocks[]. */
+static size_t site_cnt;         /* Slots in use in sites[]. */
+static size_t untracked_cnt;    /* Allocations that did not fit. */
+
+/* Returns the home slot of KEY in a table of 2**BITS slots. */
+static inline size_t
+hash_key (uintptr_t key, int bits) {
+	return (key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+}
+
+/* Returns the slot for SITE in sites[], adding it if needed, or
+   -1 if the table is full. */
+static int
+find_site (uintptr_t site) {
+	size_t i;
+
+	for (i = hash_key (site, SITE_BITS); sites[i].site != 0;
+			i = (i + 1) & (SITE_CNT - 1))
+		if (sites[i].site == site)
+			return i;
+	if (site_cnt >= FULL (SITE_CNT))
+		return -1;
+	site_cnt++;
+	sites[i].site = site;
+	return i;
+}
+
+/* Returns the slot of PTR in blocks[], or the empty slot where it
+   belongs if it is not there. */
+static size_t
+find_block (uintptr_t ptr) {
+	size_t i;
+
+	for (i = hash_key (ptr, BLOCK_BITS); blocks[i].ptr != 0;
+			i = (i + 1) & (BLOCK_CNT - 1))
+		if (blocks[i].ptr == ptr)
+			break;
+	return i;
+}
+
+/* Removes the block in slot I of blocks[] and its charge to its
+   call site.  Later entries of the probe sequence are shifted
+   back so that no tombstones are needed. */
+static void
+remove_block (size_t i) {
+	struct site_rec *s = &sites[blocks[i].site];
+	size_t j = i;
+
+	s->live_cnt--;
+	s->live_bytes -= blocks[i].size;
+	block_cnt--;
+
+	for (;;) {
+		size_t home;
+
+		j = (j + 1) & (BLOCK_CNT - 1);
+		if (blocks[j].ptr == 0)
+			break;
+		home = hash_key (blocks[j].ptr, BLOCK_BITS);
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		blocks[i] = blocks[j];
+		i = j;
+	}
+	blocks[i].ptr = 0;
+}
+
+/* Records that SIZE bytes at PTR were allocated on behalf of the
+   code at SITE.  If PTR is already recorded, the new size and
+   site replace the old ones. */
+void
+memtrack_alloc (const void *ptr, size_t size, const void *site) {
+	enum intr_level old_level;
+	size_t i;
+	int s;
+
+	if (ptr == NULL)
+		return;
+
+	old_level = intr_disable ();
+	i = find_block ((uintptr_t) ptr);
+	if (blocks[i].ptr != 0) {
+		remove_block (i);
+		i = find_block ((uintptr_t) ptr);
+	}
+
+	s = find_site ((uintptr_t) site);
+	if (s < 0 || block_cnt >= FULL (BLOCK_CNT))
+		untracked_cnt++;
+	else {
+		blocks[i].ptr = (uintptr_t) ptr;
+		blocks[i].size = size;
+		blocks[i].site = s;
+		block_cnt++;
+		sites[s].live_cnt++;
+		sites[s].live_bytes += size;
+		sites[s].alloc_cnt++;
+	}
+	intr_set_level (old_level);
+}
+
+/* Records that the block at PTR was freed.  Blocks that were
+   never recorded are ignored. */
+void
+memtrack_free (const void *ptr) {
+	enum intr_level old_level;
+	size_t i;
+
+	if (ptr == NULL)
+		return;
+
+	old_level = intr_disable ();
+	i = find_block ((uintptr_t) ptr);
+	if (blocks[i].ptr != 0)
+		remove_block (i);
+	intr_set_level (old_level);
+}
+
+/* Prints the TOP_CNT call sites that hold the most memory,
+   largest first, then the totals. */
+void
+memtrack_dump (void) {
+	static struct site_rec snap[SITE_CNT];
+	static uint16_t order[SITE_CNT];
+	enum intr_level old_level;
+	size_t order_cnt = 0;
+	size_t live_bytes = 0;
+	size_t snap_block_cnt, snap_untracked_cnt;
+	size_t i;
+
+	/* Take a snapshot, so that the tables do not change under us
+	   while printing. */
+	old_level = intr_disable ();
+	for (i = 0; i < SITE_CNT; i++)
+		snap[i] = sites[i];
+	snap_block_cnt = block_cnt;
+	snap_untracked_cnt = untracked_cnt;
+	intr_set_level (old_level);
+
+	/* Insertion sort of the sites with live memory, by bytes. */
+	for (i = 0; i < SITE_CNT; i++) {
+		size_t j;
+
+		if (snap[i].live_cnt == 0)
+			continue;
+		live_bytes += snap[i].live_bytes;
+		for (j = order_cnt++; j > 0
+				&& snap[order[j - 1]].live_bytes < snap[i].live_bytes; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	printf ("memtrack: %zu live blocks, %zu bytes, from %zu sites; "
+			"%zu allocations untracked\n", snap_block_cnt, live_bytes,
+			order_cnt, snap_untracked_cnt);
+	printf ("memtrack: %-18s %8s %10s %10s\n",
+			"site", "blocks", "bytes", "allocs");
+	for (i = 0; i < order_cnt && i < TOP_CNT; i++) {
+		struct site_rec *s = &snap[order[i]];
+		printf ("memtrack: %#018llx %8zu %10zu %10llu\n",
+				(unsigned long long) s->site, s->live_cnt, s->live_bytes,
+				s->alloc_cnt);
+	}
+}
+
+#else /* !MEMTRACK */
+
+/* Explains how to turn accounting on. */
+void
+memtrack_dump (void) {
+	printf ("memtrack: not compiled in; build with -DMEMTRACK\n");
+}
+
+#endif /* MEMTRACK */
@@ -2,12 +2,18 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+static void pcid_forget (uint64_t *pml4);
+static uint64_t *pt_alloc (bool zero);
+static void pt_free (void *page);
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -15,7 +21,7 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (true);
 				if (new_page)
 					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 				else
@@ -37,7 +43,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
 		if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (true);
 				if (new_page) {
 					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -49,7 +55,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
+		pt_free ((void *) ptov (PTE_ADDR (pdpe[idx])));
 		pdpe[idx] = 0;
 	}
 	return pte;
@@ -70,7 +76,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		uint64_t *pdpe = (uint64_t *) pml4e[idx];
 		if (!((uint64_t) pdpe & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (true);
 				if (new_page) {
 					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -82,7 +88,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
+		pt_free ((void *) ptov (PTE_ADDR (pml4e[idx])));
 		pml4e[idx] = 0;
 	}
 	return pte;
@@ -94,7 +100,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
  * allocation fails. */
 uint64_t *
 pml4_create (void) {
-	uint64_t *pml4 = palloc_get_page (0);
+	uint64_t *pml4 = pt_alloc (false);
 	if (pml4)
 		memcpy (pml4, base_pml4, PGSIZE);
 	return pml4;
@@ -155,57 +161,332 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Page-table pages.
+ *
+ * Tearing down an address space frees every page-table page it
+ * has, and the next pml4_create() and page faults ask for them
+ * right back, so up to PT_CACHE_MAX of them are set aside instead
+ * of going back to palloc.  Cached pages are zeroed on reuse.
+ *
+ * The rest of a dead address space's pages, user frames
+ * included, are collected into batches for palloc_free_batch(),
+ * which takes each pool lock once a batch rather than once a
+ * page.  After pml4_reaper_start(), pml4_destroy() only queues
+ * the page table and a low-priority reaper thread does the
+ * freeing, so exiting processes do not wait for it.  If memory
+ * runs short meanwhile, palloc calls pml4_reap() to catch up. */
+#define PT_CACHE_MAX 64
+#define FREE_BATCH 32
+#define DEAD_MAX 32
+
+static void *pt_cache[PT_CACHE_MAX];
+static size_t pt_cache_cnt;
+
+/* Page tables waiting for the reaper. */
+static uint64_t *dead_pml4s[DEAD_MAX];
+static size_t dead_cnt;
+static bool reaper_running;
+static struct semaphore reaper_sema;
+
+/* Pages to be freed together. */
+struct free_batch {
+	void *pages[FREE_BATCH];
+	size_t cnt;
+};
+
+/* Returns a page for a page table, zeroed if ZERO, or a null
+ * pointer if memory is exhausted. */
+static uint64_t *
+pt_alloc (bool zero) {
+	void *page = NULL;
+
+	enum intr_level old_level = intr_disable ();
+	if (pt_cache_cnt > 0)
+		page = pt_cache[--pt_cache_cnt];
+	intr_set_level (old_level);
+
+	if (page == NULL)
+		return palloc_get_page (zero ? PAL_ZERO : 0);
+	if (zero)
+		memset (page, 0, PGSIZE);
+	return page;
+}
+
+/* Puts page-table page PAGE in the cache.  Returns false if the
+ * cache is full. */
+static bool
+pt_cache_put (void *page) {
+	bool success = false;
+
+	enum intr_level old_level = intr_disable ();
+	if (pt_cache_cnt < PT_CACHE_MAX) {
+		pt_cache[pt_cache_cnt++] = page;
+		success = true;
+	}
+	intr_set_level (old_level);
+	return success;
+}
+
+/* Frees page-table page PAGE. */
+static void
+pt_free (void *page) {
+	if (!pt_cache_put (page))
+		palloc_free_page (page);
+}
+
+static void
+batch_flush (struct free_batch *b) {
+	palloc_free_batch (b->pages, b->cnt);
+	b->cnt = 0;
+}
+
+static void
+batch_add (struct free_batch *b, void *page) {
+	if (b->cnt == FREE_BATCH)
+		batch_flush (b);
+	b->pages[b->cnt++] = page;
+}
+
+/* Frees page-table page PAGE, preferably into the cache. */
+static void
+batch_add_pt (struct free_batch *b, void *page) {
+	if (!pt_cache_put (page))
+		batch_add (b, page);
+}
+
 static void
-pt_destroy (uint64_t *pt) {
+pt_destroy (uint64_t *pt, struct free_batch *b) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
 		if (((uint64_t) pte) & PTE_P)
-			palloc_free_page ((void *) PTE_ADDR (pte));
+			batch_add (b, (void *) PTE_ADDR (pte));
 	}
-	palloc_free_page ((void *) pt);
+	batch_add_pt (b, pt);
 }
 
 static void
-pgdir_destroy (uint64_t *pdp) {
+pgdir_destroy (uint64_t *pdp, struct free_batch *b) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
 		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+			pt_destroy (PTE_ADDR (pte), b);
 	}
-	palloc_free_page ((void *) pdp);
+	batch_add_pt (b, pdp);
 }
 
 static void
-pdpe_destroy (uint64_t *pdpe) {
+pdpe_destroy (uint64_t *pdpe, struct free_batch *b) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
 		if (((uint64_t) pde) & PTE_P)
-			pgdir_destroy ((void *) PTE_ADDR (pde));
+			pgdir_destroy ((void *) PTE_ADDR (pde), b);
 	}
-	palloc_free_page ((void *) pdpe);
+	batch_add_pt (b, pdpe);
 }
 
-/* Destroys pml4e, freeing all the pages it references. */
+/* Frees PML4 and all the pages it references. */
+static void
+pml4_free (uint64_t *pml4) {
+	struct free_batch b;
+
+	b.cnt = 0;
+	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
+	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
+	if (((uint64_t) pdpe) & PTE_P)
+		pdpe_destroy ((void *) PTE_ADDR (pdpe), &b);
+	batch_add_pt (&b, pml4);
+	batch_flush (&b);
+}
+
+/* Destroys pml4e, freeing all the pages it references, possibly
+ * later in the reaper thread.  PML4 must not be active. */
 void
 pml4_destroy (uint64_t *pml4) {
+	bool queued = false;
+
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
 
-	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
-	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
-	if (((uint64_t) pdpe) & PTE_P)
-		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-	palloc_free_page ((void *) pml4);
+	pcid_forget (pml4);
+	if (reaper_running) {
+		enum intr_level old_level = intr_disable ();
+		if (dead_cnt < DEAD_MAX) {
+			dead_pml4s[dead_cnt++] = pml4;
+			queued = true;
+		}
+		intr_set_level (old_level);
+	}
+
+	if (queued)
+		sema_up (&reaper_sema);
+	else
+		pml4_free (pml4);
+}
+
+/* Frees every page table queued for the reaper. */
+void
+pml4_reap (void) {
+	for (;;) {
+		uint64_t *pml4 = NULL;
+
+		enum intr_level old_level = intr_disable ();
+		if (dead_cnt > 0)
+			pml4 = dead_pml4s[--dead_cnt];
+		intr_set_level (old_level);
+
+		if (pml4 == NULL)
+			break;
+		pml4_free (pml4);
+	}
+}
+
+static void
+reaper (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&reaper_sema);
+		pml4_reap ();
+	}
+}
+
+/* Starts the reaper thread, so that pml4_destroy() hands its
+ * work off instead of doing it at once. */
+void
+pml4_reaper_start (void) {
+	sema_init (&reaper_sema, 0);
+	if (thread_create ("reaper", PRI_MIN, reaper, NULL) == TID_ERROR)
+		return;
+	palloc_set_reclaim_func (pml4_reap);
+	reaper_running = true;
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  Any TLB entries tagged with PCID 0 are flushed, but
+ * the kernel's global mappings survive. */
 void
 pml4_activate (uint64_t *pml4) {
 	lcr3 (vtop (pml4 ? pml4 : base_pml4));
 }
 
+/* Process-context identifiers.
+ *
+ * PCID 0 belongs to base_pml4 and to pml4_activate(); PCIDs
+ * 1...PCID_CNT - 1 are handed out to address spaces in order as
+ * they are activated.  An address space's PCID stays valid until
+ * the counter wraps, at which point the generation is bumped,
+ * every PCID becomes invalid at once, and the whole TLB is
+ * flushed.  Because a PCID is never reused within a generation,
+ * loading a fresh one can skip the flush too.
+ *
+ * A PCID is also dropped, without being reused, when its page
+ * table is destroyed or changed while it is not the active one,
+ * since invlpg only reaches the current PCID's entries.  Clearing
+ * an accessed bit is the exception: a stale TLB entry only keeps
+ * the CPU from setting the bit again, which is harmless.
+ *
+ * Each page table records the PCID last assigned to it in entry
+ * PCID_SLOT, which no mapping uses, so that dropping it takes no
+ * search.  The entry is not present, so the CPU ignores the rest
+ * of its bits. */
+#define PCID_CNT 4096
+#define PCID_SLOT (PGSIZE / sizeof (uint64_t) - 1)
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep the PCID's TLB entries. */
+#define CR0_WP (1 << 16)                /* Kernel honors read-only. */
+#define CR4_PGE (1 << 7)                /* Global pages. */
+#define CR4_PCIDE (1 << 17)             /* PCIDs in CR3[11:0]. */
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_ECX_PCID (1 << 17)
+
+static bool pcid_enabled;
+static uint64_t pcid_gen = 1;           /* 0 marks "never assigned". */
+static uint16_t pcid_next = 1;
+static uint64_t *pcid_owner[PCID_CNT];  /* Page table holding each PCID. */
+
+/* Turns on write protection, so that kernel writes to read-only
+ * user pages fault the way user writes do, and global pages and
+ * PCIDs if the CPU has them.  Returns the PTE flags the kernel's
+ * own mappings should carry. */
+uint64_t
+mmu_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t kernel_flags = 0;
+
+	lcr0 (rcr0 () | CR0_WP);
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (edx & CPUID_EDX_PGE) {
+		lcr4 (rcr4 () | CR4_PGE);
+		kernel_flags |= PTE_G;
+	}
+	/* Requires CR3[11:0] to be 0, as it is for the loader's
+	 * page table. */
+	if (ecx & CPUID_ECX_PCID) {
+		lcr4 (rcr4 () | CR4_PCIDE);
+		pcid_enabled = true;
+	}
+	return kernel_flags;
+}
+
+/* Flushes every TLB entry for every PCID, global ones included,
+ * by toggling CR4.PGE. */
+static void
+flush_all (void) {
+	uint64_t cr4 = rcr4 ();
+	lcr4 (cr4 ^ CR4_PGE);
+	lcr4 (cr4);
+}
+
+/* Drops the PCID held by PML4, if any, so that its stale TLB
+ * entries are never used again. */
+static void
+pcid_forget (uint64_t *pml4) {
+	if (!pcid_enabled)
+		return;
+
+	enum intr_level old_level = intr_disable ();
+	uint16_t id = pml4[PCID_SLOT] >> 1;
+	if (id != 0 && pcid_owner[id] == pml4)
+		pcid_owner[id] = NULL;
+	intr_set_level (old_level);
+}
+
+/* Loads PML4 like pml4_activate(), tagging it with the PCID in
+ * PCID, assigning a new one first if it is no longer valid.
+ * TLB entries already cached under the PCID are kept. */
+void
+pml4_activate_pcid (uint64_t *pml4, struct pcid *pcid) {
+	ASSERT (pml4 != NULL);
+
+	if (!pcid_enabled) {
+		pml4_activate (pml4);
+		return;
+	}
+
+	enum intr_level old_level = intr_disable ();
+	if (pcid->gen != pcid_gen || pcid_owner[pcid->id] != pml4) {
+		if (pcid_next == PCID_CNT) {
+			memset (pcid_owner, 0, sizeof pcid_owner);
+			pcid_gen++;
+			pcid_next = 1;
+			flush_all ();
+		}
+		pcid->id = pcid_next++;
+		pcid->gen = pcid_gen;
+		pcid_owner[pcid->id] = pml4;
+		pml4[PCID_SLOT] = (uint64_t) pcid->id << 1;
+	}
+	lcr3 (vtop (pml4) | pcid->id | CR3_NOFLUSH);
+	intr_set_level (old_level);
+}
+
+/* Invalidates the TLB entry for VA in PML4. */
+static void
+flush_page (uint64_t *pml4, uint64_t va) {
+	if (PTE_ADDR (rcr3 ()) == vtop (pml4))
+		invlpg (va);
+	else
+		pcid_forget (pml4);
+}
+
 /* Looks up the physical address that corresponds to user virtual
  * address UADDR in pml4.  Returns the kernel virtual address
  * corresponding to that physical address, or a null pointer if
@@ -257,8 +538,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		flush_page (pml4, (uint64_t) upage);
 	}
 }
 
@@ -283,8 +563,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		flush_page (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -309,7 +588,97 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		/* Another address space keeps its PCID: see above. */
+		if (accessed || PTE_ADDR (rcr3 ()) == vtop (pml4))
+			flush_page (pml4, (uint64_t) vpage);
+	}
+}
+
+/* Range operations.
+ *
+ * These walk down from the PML4 once per page table and flush the
+ * TLB once per range.  Only munmap needs them.  Exit frees the
+ * whole tree with pml4_destroy(), which already visits each page
+ * table once and flushes nothing, and fork fills an empty table
+ * one page at a time in hash order without touching the parent's
+ * PTEs, so neither has a range to batch. */
+
+/* Page table entries in one page table. */
+#define PT_ENTRY_CNT (PGSIZE / sizeof (uint64_t))
+
+/* Above this many pages, pml4_clear_range() flushes the whole TLB
+ * instead of invalidating page by page. */
+#define FLUSH_PAGE_MAX 32
+
+/* Returns the number of pages, at most PAGE_CNT, from user virtual
+ * address VA to the end of the page table that maps it. */
+static size_t
+pt_span (uint64_t va, size_t page_cnt) {
+	size_t left = PT_ENTRY_CNT - PTX (va);
+	return page_cnt < left ? page_cnt : left;
+}
+
+/* Applies FUNC to the present PTE of each of the PAGE_CNT user
+ * virtual pages starting at UPAGE in PML4, in address order.
+ * Walks down from PML4 once per page table rather than once per
+ * page.  Stops and returns false as soon as FUNC does; otherwise
+ * returns true. */
+bool
+pml4_for_range (uint64_t *pml4, void *upage, size_t page_cnt,
+		pte_for_each_func *func, void *aux) {
+	uint64_t va = (uint64_t) upage;
+
+	ASSERT (pg_ofs (upage) == 0);
+
+	while (page_cnt > 0) {
+		size_t n = pt_span (va, page_cnt);
+		uint64_t *pte = pml4e_walk (pml4, va, false);
+
+		if (pte != NULL)
+			for (size_t i = 0; i < n; i++)
+				if ((pte[i] & PTE_P)
+						&& !func (&pte[i], (void *) (va + i * PGSIZE), aux))
+					return false;
+		va += n * PGSIZE;
+		page_cnt -= n;
 	}
+	return true;
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+ * present" in PML4, like pml4_clear_page() on each.  If PML4 is
+ * active, the TLB is flushed once at the end: page by page for
+ * short ranges, all at once for long ones. */
+void
+pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt) {
+	uint64_t va = (uint64_t) upage;
+	size_t left = page_cnt;
+	bool cleared = false;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	while (left > 0) {
+		size_t n = pt_span (va, left);
+		uint64_t *pte = pml4e_walk (pml4, va, false);
+
+		if (pte != NULL)
+			for (size_t i = 0; i < n; i++)
+				if (pte[i] & PTE_P) {
+					pte[i] &= ~PTE_P;
+					cleared = true;
+				}
+		va += n * PGSIZE;
+		left -= n;
+	}
+
+	if (!cleared)
+		return;
+	if (PTE_ADDR (rcr3 ()) != vtop (pml4))
+		pcid_forget (pml4);
+	else if (page_cnt <= FLUSH_PAGE_MAX)
+		for (size_t i = 0; i < page_cnt; i++)
+			invlpg ((uint64_t) upage + i * PGSIZE);
+	else
+		lcr3 (rcr3 ());
 }
@@ -2,13 +2,16 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/memtrack.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -24,13 +27,87 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   each aligned to its own size relative to the pool base, on one
+   free list per order.  An allocation takes the smallest block
+   that is big enough, splits off the unused halves, and returns
+   the pages past PAGE_CNT.  Freeing a block merges it with its
+   "buddy", the other half of the block it was split from, for as
+   long as the buddy is free too.  Both take O(log n) time.
+
+   The buddy state lives in an array beside the pool's bitmap
+   rather than in the free pages themselves, because the pools
+   are populated before paging_init() maps all of memory.  The
+   bitmap still records which pages are in use, for sanity
+   checks.
+
+   Single pages, by far the most common request, are served from
+   a small per-pool "magazine" of free pages in front of the
+   buddy allocator.  Pintos has one CPU, so the magazine needs no
+   lock: pushing or popping a page with interrupts disabled is
+   enough, and the pool lock is taken only to refill or drain the
+   magazine MAG_BATCH pages at a time.  Pages in a magazine are
+   still marked used in the pool's bitmap.
+
+   Pages may be freed with interrupts off, notably by the
+   scheduler, which frees dying threads' pages.  Such a free must
+   not sleep on the pool lock, which the running thread may even
+   hold already.  When the magazine cannot take the pages, they go
+   on the pool's "deferred" list instead, linked through the pages
+   themselves, and the next allocation from the pool returns them
+   to the buddy allocator.  Until then they stay marked used.
+
+   When a multi-page user allocation fails even though enough
+   pages are free, compact() makes room by moving the in-use pages
+   out of one suitably sized and aligned block.  Only the VM
+   subsystem knows how to move a user page, so it registers a
+   migration callback with palloc_set_migrate_func().  Pages the
+   callback refuses to move make compaction give up.
+
+   A subsystem that defers freeing pages, such as the page-table
+   reaper in threads/mmu.c, registers a callback with
+   palloc_set_reclaim_func() that palloc_get_multiple() calls
+   once before giving up. */
+
+/* Largest block order.  Blocks of 2**MAX_ORDER pages cover 4 GB. */
+#define MAX_ORDER 20
+
+/* Buddy allocator state of one page. */
+struct buddy_page {
+	struct list_elem elem;          /* Free list element. */
+	int order;                      /* Order if head of a free block, else -1. */
+};
+
+/* Capacity of a magazine, and the number of pages moved between
+   a magazine and its pool at once. */
+#define MAG_SIZE 32
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* A cache of free single pages. */
+struct magazine {
+	void *pages[MAG_SIZE];          /* Free pages. */
+	size_t cnt;                     /* Number of pages in PAGES. */
+};
+
+/* A free block on a pool's deferred list, stored in the block
+   itself. */
+struct deferred_block {
+	struct deferred_block *next;    /* Next block on the list. */
+	size_t page_cnt;                /* Number of pages in the block. */
+};
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct buddy_page *pages;       /* Buddy state, one per page. */
+	struct list free_lists[MAX_ORDER + 1];  /* Free blocks by order. */
+	struct magazine mag;            /* Free single pages. */
+	struct deferred_block *deferred;        /* Frees awaiting the lock. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +115,30 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Moves user pages for compaction, or null if none registered. */
+static palloc_migrate_func *migrate_func;
+
+/* Frees lazily held pages, or null if none registered. */
+static palloc_reclaim_func *reclaim_func;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static struct pool *pool_of (void *page);
+static void *get_pages (struct pool *, size_t page_cnt);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *pool_take (struct pool *, size_t page_cnt);
+static void pool_give (struct pool *, void *pages, size_t page_cnt);
+static size_t pool_take_batch (struct pool *, void *pages[], size_t cnt);
+static void pool_give_batch (struct pool *, void *pages[], size_t cnt);
+static void *mag_get (struct pool *);
+static bool mag_put (struct pool *, void *page);
+static void mag_drain (struct pool *);
+static void defer_free (struct pool *, void *pages, size_t page_cnt);
+static void give_deferred (struct pool *);
+static void *compact (struct pool *, size_t page_cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -224,11 +321,13 @@ split:
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -262,16 +361,13 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	pages = get_pages (pool, page_cnt);
+	if (pages == NULL && reclaim_func != NULL && !intr_context ()) {
+		reclaim_func ();
+		pages = get_pages (pool, page_cnt);
+	}
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -281,6 +377,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 			PANIC ("palloc_get: out of pages");
 	}
 
+	memtrack_alloc (pages, PGSIZE * page_cnt, MEMTRACK_CALLER);
 	return pages;
 }
 
@@ -293,33 +390,32 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	void *page = palloc_get_multiple (flags, 1);
+
+	memtrack_alloc (page, PGSIZE, MEMTRACK_CALLER);
+	return page;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
-	size_t page_idx;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
 		return;
-
-	if (page_from_pool (&kernel_pool, pages))
-		pool = &kernel_pool;
-	else if (page_from_pool (&user_pool, pages))
-		pool = &user_pool;
-	else
-		NOT_REACHED ();
-
-	page_idx = pg_no (pages) - pg_no (pool->base);
+	memtrack_free (pages);
+	pool = pool_of (pages);
 
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
-	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (page_cnt == 1 && mag_put (pool, pages))
+		return;
+	if (intr_get_level () == INTR_OFF)
+		defer_free (pool, pages, page_cnt);
+	else
+		pool_give (pool, pages, page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +424,45 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Frees the CNT single pages in PAGES[], taking each pool's lock
+   once per run of pages from the same pool rather than once per
+   page.  Meant for tearing down many pages at once; the pages
+   skip the magazines and go straight back to the buddy
+   allocator. */
+void
+palloc_free_batch (void *pages[], size_t cnt) {
+	size_t i = 0;
+
+	while (i < cnt) {
+		struct pool *pool = pool_of (pages[i]);
+		size_t j;
+
+		for (j = i; j < cnt && page_from_pool (pool, pages[j]); j++) {
+			ASSERT (pg_ofs (pages[j]) == 0);
+			memtrack_free (pages[j]);
+#ifndef NDEBUG
+			memset (pages[j], 0xcc, PGSIZE);
+#endif
+		}
+		pool_give_batch (pool, pages + i, j - i);
+		i = j;
+	}
+}
+
+/* Registers FUNC to move user pages when the user pool needs
+   compaction. */
+void
+palloc_set_migrate_func (palloc_migrate_func *func) {
+	migrate_func = func;
+}
+
+/* Registers FUNC to free lazily held pages when an allocation
+   fails. */
+void
+palloc_set_reclaim_func (palloc_reclaim_func *func) {
+	reclaim_func = func;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -336,6 +471,8 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t buddy_pages = DIV_ROUND_UP (pgcnt * sizeof *p->pages, PGSIZE) * PGSIZE;
+	size_t i;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
@@ -345,6 +482,17 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// No free blocks until populate_pools() hands us usable pages.
+	p->pages = *bm_base;
+	for (i = 0; i < pgcnt; i++)
+		p->pages[i].order = -1;
+	for (i = 0; i <= MAX_ORDER; i++)
+		list_init (&p->free_lists[i]);
+	p->mag.cnt = 0;
+	p->deferred = NULL;
+
+	*bm_base += buddy_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +504,426 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static int
+order_of (size_t page_cnt) {
+	int order = 0;
+
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	return order;
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX in POOL on
+   its free list, without merging. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) {
+	pool->pages[page_idx].order = order;
+	list_push_front (&pool->free_lists[order], &pool->pages[page_idx].elem);
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy as many times as possible. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) {
+	size_t page_cnt = bitmap_size (pool->used_map);
+
+	while (order < MAX_ORDER) {
+		size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+		struct buddy_page *buddy;
+
+		if (buddy_idx >= page_cnt)
+			break;
+		buddy = &pool->pages[buddy_idx];
+		if (buddy->order != order)
+			break;
+
+		list_remove (&buddy->elem);
+		buddy->order = -1;
+		page_idx &= ~((size_t) 1 << order);
+		order++;
+	}
+	push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block: the range is split into the
+   largest aligned blocks that fit. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order < MAX_ORDER
+				&& (page_idx & ((size_t) 1 << order)) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is big
+   enough.  The pool's lock must be held. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	int order = order_of (page_cnt);
+	int k;
+	size_t page_idx;
+
+	if (page_cnt == 0 || order > MAX_ORDER)
+		return BITMAP_ERROR;
+
+	for (k = order; k <= MAX_ORDER; k++)
+		if (!list_empty (&pool->free_lists[k]))
+			break;
+	if (k > MAX_ORDER)
+		return BITMAP_ERROR;
+
+	struct buddy_page *head = list_entry (list_pop_front (&pool->free_lists[k]),
+			struct buddy_page, elem);
+	head->order = -1;
+	page_idx = head - pool->pages;
+
+	/* Split off the upper halves we do not need, then give back
+	   the tail of the block beyond PAGE_CNT. */
+	while (k > order) {
+		k--;
+		push_block (pool, page_idx + ((size_t) 1 << k), k);
+	}
+	buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return page_idx;
+}
+
+/* Returns the pool that PAGE belongs to. */
+static struct pool *
+pool_of (void *page) {
+	if (page_from_pool (&kernel_pool, page))
+		return &kernel_pool;
+	else if (page_from_pool (&user_pool, page))
+		return &user_pool;
+	NOT_REACHED ();
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, compacting the
+   user pool if necessary, and returns the first, or a null
+   pointer if there are none. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt) {
+	void *pages;
+
+	if (pool->deferred != NULL)
+		give_deferred (pool);
+	if (page_cnt == 1)
+		return mag_get (pool);
+	pages = pool_take (pool, page_cnt);
+	if (pages == NULL && pool == &user_pool)
+		pages = compact (pool, page_cnt);
+	return pages;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy allocator
+   and returns the first, or a null pointer if there are none. */
+static void *
+pool_take (struct pool *pool, size_t page_cnt) {
+	size_t page_idx;
+
+	lock_acquire (&pool->lock);
+	page_idx = buddy_alloc (pool, page_cnt);
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+	lock_release (&pool->lock);
+
+	return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGES to POOL's buddy
+   allocator. */
+static void
+pool_give (struct pool *pool, void *pages, size_t page_cnt) {
+	size_t page_idx = pg_no (pages) - pg_no (pool->base);
+
+	lock_acquire (&pool->lock);
+	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	buddy_free (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
+}
+
+/* Allocates up to CNT single pages from POOL into PAGES[] under
+   one acquisition of the pool lock and returns how many it got. */
+static size_t
+pool_take_batch (struct pool *pool, void *pages[], size_t cnt) {
+	size_t i;
+
+	lock_acquire (&pool->lock);
+	for (i = 0; i < cnt; i++) {
+		size_t page_idx = buddy_alloc (pool, 1);
+		if (page_idx == BITMAP_ERROR)
+			break;
+		ASSERT (!bitmap_test (pool->used_map, page_idx));
+		bitmap_mark (pool->used_map, page_idx);
+		pages[i] = pool->base + PGSIZE * page_idx;
+	}
+	lock_release (&pool->lock);
+	return i;
+}
+
+/* Returns the CNT single pages in PAGES[] to POOL under one
+   acquisition of the pool lock. */
+static void
+pool_give_batch (struct pool *pool, void *pages[], size_t cnt) {
+	size_t i;
+
+	if (cnt == 0)
+		return;
+	lock_acquire (&pool->lock);
+	for (i = 0; i < cnt; i++) {
+		size_t page_idx = pg_no (pages[i]) - pg_no (pool->base);
+		ASSERT (bitmap_test (pool->used_map, page_idx));
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	lock_release (&pool->lock);
+}
+
+/* Returns a free page from POOL's magazine, refilling the
+   magazine from the pool if it is empty, or a null pointer if the
+   pool is out of pages. */
+static void *
+mag_get (struct pool *pool) {
+	struct magazine *mag = &pool->mag;
+	void *batch[MAG_BATCH];
+	enum intr_level old_level;
+	void *page = NULL;
+	size_t batch_cnt, i;
+
+	old_level = intr_disable ();
+	if (mag->cnt > 0)
+		page = mag->pages[--mag->cnt];
+	intr_set_level (old_level);
+	if (page != NULL)
+		return page;
+
+	/* Refill.  Taking the lock may sleep, so other threads can
+	   fill the magazine meanwhile; return what does not fit. */
+	batch_cnt = pool_take_batch (pool, batch, MAG_BATCH);
+	if (batch_cnt == 0)
+		return NULL;
+	page = batch[--batch_cnt];
+
+	old_level = intr_disable ();
+	for (i = 0; i < batch_cnt && mag->cnt < MAG_SIZE; i++)
+		mag->pages[mag->cnt++] = batch[i];
+	intr_set_level (old_level);
+	pool_give_batch (pool, batch + i, batch_cnt - i);
+	return page;
+}
+
+/* Puts free PAGE into POOL's magazine, first draining MAG_BATCH
+   pages back to the pool if the magazine is full.  Returns false,
+   leaving PAGE to the caller, if the magazine is full and
+   interrupts are off, so that draining it could not take the pool
+   lock. */
+static bool
+mag_put (struct pool *pool, void *page) {
+	struct magazine *mag = &pool->mag;
+	void *batch[MAG_BATCH];
+	enum intr_level old_level;
+	size_t batch_cnt = 0;
+
+	old_level = intr_disable ();
+	if (mag->cnt == MAG_SIZE) {
+		if (old_level == INTR_OFF)
+			return false;
+		while (batch_cnt < MAG_BATCH)
+			batch[batch_cnt++] = mag->pages[--mag->cnt];
+	}
+	mag->pages[mag->cnt++] = page;
+	intr_set_level (old_level);
+
+	pool_give_batch (pool, batch, batch_cnt);
+	return true;
+}
+
+/* Puts the PAGE_CNT free pages starting at PAGES on POOL's
+   deferred list.  Interrupts must be off. */
+static void
+defer_free (struct pool *pool, void *pages, size_t page_cnt) {
+	struct deferred_block *b = pages;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	b->page_cnt = page_cnt;
+	b->next = pool->deferred;
+	pool->deferred = b;
+}
+
+/* Returns the blocks on POOL's deferred list to the buddy
+   allocator.  May sleep. */
+static void
+give_deferred (struct pool *pool) {
+	struct deferred_block *b, *next;
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+	b = pool->deferred;
+	pool->deferred = NULL;
+	intr_set_level (old_level);
+
+	for (; b != NULL; b = next) {
+		next = b->next;
+		pool_give (pool, b, b->page_cnt);
+	}
+}
+
+/* Returns every page in POOL's magazine to the buddy allocator,
+   so that compaction sees them as free. */
+static void
+mag_drain (struct pool *pool) {
+	struct magazine *mag = &pool->mag;
+	void *batch[MAG_SIZE];
+	enum intr_level old_level;
+	size_t batch_cnt = 0;
+
+	old_level = intr_disable ();
+	while (mag->cnt > 0)
+		batch[batch_cnt++] = mag->pages[--mag->cnt];
+	intr_set_level (old_level);
+
+	pool_give_batch (pool, batch, batch_cnt);
+}
+
+/* Claims every free block of POOL that lies in the WIN_SIZE pages
+   starting at page START, marking them in OWNED.  The pool's lock
+   must be held. */
+static void
+claim_free (struct pool *pool, size_t start, size_t win_size,
+		struct bitmap *owned) {
+	size_t i = 0;
+
+	while (i < win_size) {
+		struct buddy_page *head = &pool->pages[start + i];
+		int order = head->order;
+		size_t cnt;
+
+		if (order < 0) {
+			i++;
+			continue;
+		}
+
+		/* A free block bigger than what is left of the window
+		   starts at the window and covers it: keep its upper
+		   halves free. */
+		list_remove (&head->elem);
+		head->order = -1;
+		while (((size_t) 1 << order) > win_size - i) {
+			order--;
+			push_block (pool, start + i + ((size_t) 1 << order), order);
+		}
+
+		cnt = (size_t) 1 << order;
+		bitmap_set_multiple (pool->used_map, start + i, cnt, true);
+		bitmap_set_multiple (owned, i, cnt, true);
+		i += cnt;
+	}
+}
+
+/* Allocates a page from POOL outside the WIN_SIZE pages starting
+   at page START.  Free pages inside that range that turn up along
+   the way are claimed and marked in OWNED.  Returns a null
+   pointer if POOL has no page outside the range. */
+static void *
+take_outside (struct pool *pool, size_t start, size_t win_size,
+		struct bitmap *owned) {
+	size_t page_idx;
+
+	lock_acquire (&pool->lock);
+	while ((page_idx = buddy_alloc (pool, 1)) != BITMAP_ERROR) {
+		bitmap_mark (pool->used_map, page_idx);
+		if (page_idx - start >= win_size)
+			break;
+		bitmap_mark (owned, page_idx - start);
+	}
+	lock_release (&pool->lock);
+
+	return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Tries to free up PAGE_CNT contiguous pages in POOL by moving the
+   in-use pages out of the aligned block that has the fewest of
+   them.  Returns the pages, already allocated, on success, or a
+   null pointer on failure. */
+static void *
+compact (struct pool *pool, size_t page_cnt) {
+	size_t pool_size = bitmap_size (pool->used_map);
+	size_t win_size = (size_t) 1 << order_of (page_cnt);
+	size_t start = BITMAP_ERROR;
+	size_t best_used = SIZE_MAX;
+	struct bitmap *owned;
+	size_t i;
+
+	if (migrate_func == NULL || win_size > pool_size || intr_context ())
+		return NULL;
+
+	/* Pick the window that needs the fewest moves. */
+	mag_drain (pool);
+	lock_acquire (&pool->lock);
+	for (i = 0; i + win_size <= pool_size; i += win_size) {
+		size_t used = bitmap_count (pool->used_map, i, win_size, true);
+		if (used < best_used) {
+			best_used = used;
+			start = i;
+		}
+	}
+	lock_release (&pool->lock);
+	if (start == BITMAP_ERROR)
+		return NULL;
+
+	owned = bitmap_create (win_size);
+	if (owned == NULL)
+		return NULL;
+	lock_acquire (&pool->lock);
+	claim_free (pool, start, win_size, owned);
+	lock_release (&pool->lock);
+
+	/* Move every page we do not own yet out of the window. */
+	for (i = 0; i < win_size; i++) {
+		void *new_page;
+
+		if (bitmap_test (owned, i))
+			continue;
+		new_page = take_outside (pool, start, win_size, owned);
+		if (new_page == NULL)
+			break;
+		if (bitmap_test (owned, i)) {
+			/* Freed and claimed while looking for NEW_PAGE. */
+			pool_give (pool, new_page, 1);
+			continue;
+		}
+		if (!migrate_func (pool->base + PGSIZE * (start + i), new_page)) {
+			pool_give (pool, new_page, 1);
+			break;
+		}
+		bitmap_mark (owned, i);
+	}
+
+	if (i < win_size) {
+		/* Give up, returning what we claimed. */
+		for (i = 0; i < win_size; i++)
+			if (bitmap_test (owned, i))
+				pool_give (pool, pool->base + PGSIZE * (start + i), 1);
+		bitmap_destroy (owned);
+		return NULL;
+	}
+
+	bitmap_destroy (owned);
+	if (win_size > page_cnt)
+		pool_give (pool, pool->base + PGSIZE * (start + page_cnt),
+				win_size - page_cnt);
+	return pool->base + PGSIZE * start;
+}
@@ -0,0 +1,229 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/memtrack.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size kernel objects.
+
+   Each cache hands out objects of a single size.  Its memory
+   comes from the page allocator one page, called a "slab", at a
+   time.  A slab starts with a header and is then divided into
+   object slots.  Free slots within a slab are chained through a
+   pointer stored just past the object, so a free object keeps
+   whatever state its constructor gave it.
+
+   The cache keeps a list of slabs that have at least one free
+   slot.  Allocation pops a slot from the first of them; freeing
+   pushes the slot back onto its own slab, found by rounding the
+   object's address down to a page boundary.  One completely free
+   slab is kept around to absorb alloc/free ping-pong, and any
+   further ones are returned to the page allocator.
+
+   Compared to malloc(), objects are packed at their own size
+   rather than the next power of 2, and compared to taking a
+   whole page per object, dozens of small objects share a page. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A cache of objects of one size. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Size requested by the creator. */
+	size_t slot_size;           /* Object plus free link, aligned. */
+	size_t objs_per_slab;       /* Number of slots in a slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+	struct lock lock;           /* Guards everything below. */
+	struct list partial_slabs;  /* Slabs with a free slot. */
+	size_t empty_cnt;           /* Slabs with no object in use. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs allocated. */
+	size_t in_use_cnt;          /* Objects allocated. */
+	unsigned long long alloc_cnt;   /* Total kmem_cache_alloc() calls. */
+	struct list_elem elem;      /* Element in cache_list. */
+};
+
+/* Header at the start of each slab. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	size_t in_use_cnt;          /* Objects in use. */
+	void *free;                 /* First free slot, or null. */
+	struct list_elem elem;      /* Element in partial_slabs. */
+};
+
+/* All caches, for kmem_print_stats(). */
+static struct list cache_list = {
+	{ NULL, &cache_list.tail },
+	{ &cache_list.head, NULL },
+};
+
+/* Returns a pointer to the free-slot link of slot OBJ in C. */
+static inline void **
+free_link (const struct kmem_cache *c, void *obj) {
+	return (void **) ((uint8_t *) obj + c->slot_size - sizeof (void *));
+}
+
+/* Returns the slab that holds OBJ. */
+static struct slab *
+obj_to_slab (void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT ((pg_ofs (obj) - ROUND_UP (sizeof *s, sizeof (void *)))
+			% s->cache->slot_size == 0);
+	return s;
+}
+
+/* Creates and returns a cache of SIZE-byte objects named NAME.
+   If CTOR is nonnull, it is run on every object when its slab is
+   created.  Panics if memory is not available, since caches are
+   created at initialization time. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor) {
+	struct kmem_cache *c = malloc (sizeof *c);
+	size_t header = ROUND_UP (sizeof (struct slab), sizeof (void *));
+
+	if (c == NULL)
+		PANIC ("kmem_cache_create: out of memory");
+	ASSERT (size > 0);
+
+	c->name = name;
+	c->obj_size = size;
+	c->slot_size = ROUND_UP (size, sizeof (void *)) + sizeof (void *);
+	c->objs_per_slab = (PGSIZE - header) / c->slot_size;
+	ASSERT (c->objs_per_slab > 0);
+	c->ctor = ctor;
+	lock_init (&c->lock);
+	list_init (&c->partial_slabs);
+	c->empty_cnt = 0;
+	c->slab_cnt = 0;
+	c->in_use_cnt = 0;
+	c->alloc_cnt = 0;
+	list_push_back (&cache_list, &c->elem);
+	return c;
+}
+
+/* Obtains a page and carves it into a slab of C's objects, which
+   is added to C's partial slabs.  Returns false if memory is not
+   available. */
+static bool
+grow (struct kmem_cache *c) {
+	struct slab *s = palloc_get_page (0);
+	uint8_t *obj;
+	size_t i;
+
+	if (s == NULL)
+		return false;
+	memtrack_free (s);
+
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->in_use_cnt = 0;
+	s->free = NULL;
+	obj = (uint8_t *) s + ROUND_UP (sizeof *s, sizeof (void *));
+	obj += (c->objs_per_slab - 1) * c->slot_size;
+	for (i = 0; i < c->objs_per_slab; i++, obj -= c->slot_size) {
+		if (c->ctor != NULL)
+			c->ctor (obj);
+		*free_link (c, obj) = s->free;
+		s->free = obj;
+	}
+
+	list_push_front (&c->partial_slabs, &s->elem);
+	c->slab_cnt++;
+	c->empty_cnt++;
+	return true;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+	if (list_empty (&c->partial_slabs) && !grow (c)) {
+		lock_release (&c->lock);
+		return NULL;
+	}
+
+	s = list_entry (list_front (&c->partial_slabs), struct slab, elem);
+	obj = s->free;
+	s->free = *free_link (c, obj);
+	if (s->in_use_cnt++ == 0)
+		c->empty_cnt--;
+	if (s->free == NULL)
+		list_remove (&s->elem);
+
+	c->in_use_cnt++;
+	c->alloc_cnt++;
+	lock_release (&c->lock);
+	memtrack_alloc (obj, c->obj_size, MEMTRACK_CALLER);
+	return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to C.
+   OBJ may be a null pointer, in which case this does nothing. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+	memtrack_free (obj);
+	s = obj_to_slab (obj);
+	ASSERT (s->cache == c);
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless
+	   a constructor has put it in a state it must keep. */
+	if (c->ctor == NULL)
+		memset (obj, 0xcc, c->obj_size);
+#endif
+
+	lock_acquire (&c->lock);
+	if (s->free == NULL)
+		list_push_front (&c->partial_slabs, &s->elem);
+	*free_link (c, obj) = s->free;
+	s->free = obj;
+	c->in_use_cnt--;
+
+	if (--s->in_use_cnt == 0) {
+		if (c->empty_cnt > 0) {
+			/* Already have a spare empty slab. */
+			list_remove (&s->elem);
+			c->slab_cnt--;
+			s->magic = 0;
+			palloc_free_page (s);
+		} else
+			c->empty_cnt++;
+	}
+	lock_release (&c->lock);
+}
+
+/* Prints usage statistics for every cache. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+		printf ("Slab %s: %zu-byte objects, %zu in use, %zu slabs, "
+				"%llu allocs\n", c->name, c->obj_size, c->in_use_cnt,
+				c->slab_cnt, c->alloc_cnt);
+	}
+}
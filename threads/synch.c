@@ -31,11 +31,29 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Number of times a contended mutex_acquire() polls a running
+   holder before it gives up and blocks. */
+#define MUTEX_SPIN_CNT 1000
+
+/* Locks and mutexes that were given a name, for
+   synch_print_stats(). */
+static struct list named_locks = {
+	{ NULL, &named_locks.tail },
+	{ &named_locks.head, NULL },
+};
+
+static void lock_stats_init (struct lock_stats *, const char *name);
 
 static bool
-sema_waiters_max_priority_more( const struct list_elem * a,
-								const struct list_elem * b,
-								void * aux UNUSED);
+waiter_priority_less (const struct heap_elem *a,
+					  const struct heap_elem *b,
+					  void *aux UNUSED);
+static bool
+cond_waiter_priority_less (const struct heap_elem *a,
+						   const struct heap_elem *b,
+						   void *aux UNUSED);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -51,7 +69,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	heap_init (&sema->waiters, waiter_priority_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -71,10 +89,15 @@ sema_down (struct semaphore *sema) {
 
 	old_level = intr_disable ();
 	while (sema->value == 0) {
-		list_insert_ordered (&sema->waiters,
-							 &thread_current ()->elem,
-							 thread_priority_more,
-							 NULL);
+		struct thread *cur = thread_current ();
+
+		heap_insert (&sema->waiters, &cur->waitelem);
+		/* cond_wait() has already queued us on its own heap, which
+		   is the one that decides when we wake up. */
+		if (cur->wait_queue == NULL) {
+			cur->wait_queue = &sema->waiters;
+			cur->wait_queue_elem = &cur->waitelem;
+		}
 		thread_block ();
 	}
 	sema->value--;
@@ -117,12 +140,13 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters))
+	if (!heap_empty (&sema->waiters))
 	{
-		/* due to priority update, we should sort list */
-		list_sort(&sema->waiters, thread_priority_more, NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
+		/* waiters heap is kept ordered on every priority change */
+		struct thread *t = heap_entry (heap_pop_max (&sema->waiters),
+				struct thread, waitelem);
+		t->wait_queue = NULL;
+		thread_unblock (t);
 	}
 	sema->value++;
 	max_priority_compare();
@@ -185,6 +209,18 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+	lock_stats_init (&lock->stats, NULL);
+}
+
+/* Names LOCK so that its contention is reported by
+   synch_print_stats().  NAME must outlive LOCK, and LOCK must
+   never be freed. */
+void
+lock_set_name (struct lock *lock, const char *name) {
+	ASSERT (lock != NULL);
+	ASSERT (lock->stats.name == NULL);
+
+	lock_stats_init (&lock->stats, name);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -202,20 +238,30 @@ lock_acquire (struct lock *lock) {
 	ASSERT (!lock_held_by_current_thread (lock));
 
 	struct thread *cur = thread_current();
-	struct thread *lock_holder = lock->holder;
-	int depth = 0;
+	enum intr_level old_level;
 
-	/* if lock holder is exist */
-	if (!thread_mlfqs && lock_holder && lock_holder->priority < cur->priority){
+	/* Donation walks other threads' wait heaps, so it must not
+	   race with sema_up() or the mlfqs priority recalculation. */
+	old_level = intr_disable ();
+
+	/* if lock holder is exist, we become one of its donors by
+	   waiting in this lock's semaphore heap */
+	if (lock->holder) {
+		lock->stats.contend_cnt++;
+		trace_record (TRACE_CONTEND, cur->tid, (uint64_t) lock,
+				lock->holder->tid);
+	}
+	if (!thread_mlfqs && lock->holder){
 		cur->wait_for_what_lock = lock;
-		list_insert_ordered(&lock_holder->donor_list, &cur->donor_elem, thread_priority_more, 0);
 		priority_donate(cur);
 	}
 	sema_down (&lock->semaphore);
 
 	lock->holder = cur;
-	if(!thread_mlfqs) cur->wait_for_what_lock = NULL;
+	lock->stats.acquire_cnt++;
+	cur->wait_for_what_lock = NULL;
 	list_push_back(&cur->locks, &lock->lockelem);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -232,8 +278,11 @@ lock_try_acquire (struct lock *lock) {
 	ASSERT (!lock_held_by_current_thread (lock));
 
 	success = sema_try_down (&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current ();
+		lock->stats.acquire_cnt++;
+		list_push_back (&lock->holder->locks, &lock->lockelem);
+	}
 	return success;
 }
 
@@ -248,14 +297,17 @@ lock_release (struct lock *lock) {
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	enum intr_level old_level = intr_disable ();
+
+	/* Donors of LOCK are exactly its waiters, so dropping LOCK
+	   from our held list drops their donation. */
 	lock->holder = NULL;
-	if(!thread_mlfqs){
-		update_donor_lock(lock);
+	list_remove(&lock->lockelem);
+	if(!thread_mlfqs)
 		priority_update(thread_current());
-	}
 
-	list_remove(&lock->lockelem);
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -268,10 +320,164 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
+/* Initializes MUTEX.  If NAME is non-null, MUTEX's contention is
+   reported by synch_print_stats(); in that case NAME must
+   outlive MUTEX and MUTEX must never be freed.
+
+   A mutex is a lock without priority donation, meant for
+   critical sections that are short and never sleep for long. */
+void
+mutex_init (struct mutex *mutex, const char *name) {
+	ASSERT (mutex != NULL);
+
+	mutex->holder = NULL;
+	heap_init (&mutex->waiters, waiter_priority_less, NULL);
+	lock_stats_init (&mutex->stats, name);
+}
+
+/* Acquires MUTEX, sleeping until it becomes available if
+   necessary.  The mutex must not already be held by the current
+   thread.
+
+   If MUTEX is free this only flips the holder.  Otherwise we poll
+   for up to MUTEX_SPIN_CNT iterations as long as the holder is
+   running on another CPU, since it will likely release MUTEX
+   soon.  On a uniprocessor the holder can never be running while
+   we are, so we block right away.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+mutex_acquire (struct mutex *mutex) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+	int spins;
+
+	ASSERT (mutex != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!mutex_held_by_current_thread (mutex));
+
+	old_level = intr_disable ();
+	if (mutex->holder == NULL) {
+		mutex->holder = cur;
+		mutex->stats.acquire_cnt++;
+		intr_set_level (old_level);
+		return;
+	}
+
+	mutex->stats.contend_cnt++;
+	trace_record (TRACE_CONTEND, cur->tid, (uint64_t) mutex,
+			mutex->holder->tid);
+	for (spins = 0; spins < MUTEX_SPIN_CNT; spins++) {
+		struct thread *holder = mutex->holder;
+		if (holder == NULL || holder->status != THREAD_RUNNING)
+			break;
+		intr_set_level (old_level);
+		asm volatile ("pause" : : : "memory");
+		old_level = intr_disable ();
+	}
+	if (mutex->holder == NULL)
+		mutex->stats.spin_cnt++;
+
+	while (mutex->holder != NULL) {
+		heap_insert (&mutex->waiters, &cur->waitelem);
+		cur->wait_queue = &mutex->waiters;
+		cur->wait_queue_elem = &cur->waitelem;
+		thread_block ();
+	}
+	mutex->holder = cur;
+	mutex->stats.acquire_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Tries to acquire MUTEX and returns true if successful or false
+   on failure.  The mutex must not already be held by the current
+   thread. */
+bool
+mutex_try_acquire (struct mutex *mutex) {
+	enum intr_level old_level;
+	bool success = false;
+
+	ASSERT (mutex != NULL);
+	ASSERT (!mutex_held_by_current_thread (mutex));
+
+	old_level = intr_disable ();
+	if (mutex->holder == NULL) {
+		mutex->holder = thread_current ();
+		mutex->stats.acquire_cnt++;
+		success = true;
+	}
+	intr_set_level (old_level);
+	return success;
+}
+
+/* Releases MUTEX, which must be owned by the current thread, and
+   wakes up the highest-priority waiter, if any.  The waiter
+   competes for MUTEX again once it runs. */
+void
+mutex_release (struct mutex *mutex) {
+	enum intr_level old_level;
+
+	ASSERT (mutex != NULL);
+	ASSERT (mutex_held_by_current_thread (mutex));
+
+	old_level = intr_disable ();
+	mutex->holder = NULL;
+	if (!heap_empty (&mutex->waiters)) {
+		struct thread *t = heap_entry (heap_pop_max (&mutex->waiters),
+				struct thread, waitelem);
+		t->wait_queue = NULL;
+		thread_unblock (t);
+		max_priority_compare ();
+	}
+	intr_set_level (old_level);
+}
+
+/* Returns true if the current thread holds MUTEX, false
+   otherwise. */
+bool
+mutex_held_by_current_thread (const struct mutex *mutex) {
+	ASSERT (mutex != NULL);
+
+	return mutex->holder == thread_current ();
+}
+
+/* Resets STATS and, if NAME is non-null, adds it to the list of
+   named locks. */
+static void
+lock_stats_init (struct lock_stats *stats, const char *name) {
+	enum intr_level old_level;
+
+	stats->name = name;
+	stats->acquire_cnt = 0;
+	stats->contend_cnt = 0;
+	stats->spin_cnt = 0;
+	if (name != NULL) {
+		old_level = intr_disable ();
+		list_push_back (&named_locks, &stats->elem);
+		intr_set_level (old_level);
+	}
+}
+
+/* Prints contention statistics of named locks and mutexes. */
+void
+synch_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&named_locks); e != list_end (&named_locks);
+			e = list_next (e)) {
+		struct lock_stats *stats = list_entry (e, struct lock_stats, elem);
+		printf ("Lock %s: %llu acquires, %llu contended, %llu spun\n",
+				stats->name, stats->acquire_cnt, stats->contend_cnt,
+				stats->spin_cnt);
+	}
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
+	struct heap_elem elem;              /* Heap element. */
 	struct semaphore semaphore;         /* This semaphore. */
+	struct thread *thread;              /* Thread waiting on it. */
 };
 
 /* Initializes condition variable COND.  A condition variable
@@ -281,7 +487,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	heap_init (&cond->waiters, cond_waiter_priority_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -307,6 +513,8 @@ cond_init (struct condition *cond) {
 void
 cond_wait (struct condition *cond, struct lock *lock) {
 	struct semaphore_elem waiter;
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
@@ -314,8 +522,14 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
-	list_insert_ordered (&cond->waiters, &waiter.elem,
-						 sema_waiters_max_priority_more, NULL);
+	waiter.thread = cur;
+
+	old_level = intr_disable ();
+	heap_insert (&cond->waiters, &waiter.elem);
+	cur->wait_queue = &cond->waiters;
+	cur->wait_queue_elem = &waiter.elem;
+	intr_set_level (old_level);
+
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
 	lock_acquire (lock);
@@ -335,13 +549,14 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED) {
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters)){
-		/* due to priority update, we should sort list */
-		list_sort(&cond->waiters, sema_waiters_max_priority_more, NULL);	
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
+	enum intr_level old_level = intr_disable ();
+	if (!heap_empty (&cond->waiters)){
+		struct semaphore_elem *waiter = heap_entry (
+				heap_pop_max (&cond->waiters), struct semaphore_elem, elem);
+		waiter->thread->wait_queue = NULL;
+		sema_up (&waiter->semaphore);
 	}
-
+	intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -355,19 +570,113 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!heap_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
 
-/* cond is list of semaphore. compare semaphore's waiter's max_priority among them */
+/* Initializes readers-writer lock RW as free. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->readers_ok);
+	cond_init (&rw->writers_ok);
+	rw->reader_cnt = 0;
+	rw->waiting_writer_cnt = 0;
+	rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_for_write (rw));
+
+	lock_acquire (&rw->lock);
+	while (rw->writer != NULL || rw->waiting_writer_cnt > 0)
+		cond_wait (&rw->readers_ok, &rw->lock);
+	rw->reader_cnt++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader out lets one waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	ASSERT (rw->reader_cnt > 0);
+	if (--rw->reader_cnt == 0)
+		cond_signal (&rw->writers_ok, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_for_write (rw));
+
+	lock_acquire (&rw->lock);
+	rw->waiting_writer_cnt++;
+	while (rw->writer != NULL || rw->reader_cnt > 0)
+		cond_wait (&rw->writers_ok, &rw->lock);
+	rw->waiting_writer_cnt--;
+	rw->writer = thread_current ();
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing.
+   Hands it to the next waiting writer if there is one, and
+   otherwise to all waiting readers. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (rwlock_held_for_write (rw));
+
+	lock_acquire (&rw->lock);
+	rw->writer = NULL;
+	if (rw->waiting_writer_cnt > 0)
+		cond_signal (&rw->writers_ok, &rw->lock);
+	else
+		cond_broadcast (&rw->readers_ok, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rw->writer == thread_current ();
+}
+
+/* Orders semaphore waiters by their (possibly donated) priority. */
 static bool
-sema_waiters_max_priority_more( const struct list_elem * a,
-								const struct list_elem * b,
-								void * aux UNUSED)
+waiter_priority_less (const struct heap_elem *a,
+					  const struct heap_elem *b,
+					  void *aux UNUSED)
 {
-	struct semaphore sema_a = list_entry(a, struct semaphore_elem, elem)->semaphore;
-	struct semaphore sema_b = list_entry(b, struct semaphore_elem, elem)->semaphore;
-	struct thread *thread_a = list_entry(list_begin(&sema_a.waiters), struct thread, elem);
-	struct thread *thread_b = list_entry(list_begin(&sema_b.waiters), struct thread, elem);
-	return thread_a->priority > thread_b->priority;
-}
\ No newline at end of file
+	struct thread *thread_a = heap_entry(a, struct thread, waitelem);
+	struct thread *thread_b = heap_entry(b, struct thread, waitelem);
+	return thread_a->priority < thread_b->priority;
+}
+
+/* Orders condition variable waiters by the priority of the thread
+   sleeping on each one's semaphore. */
+static bool
+cond_waiter_priority_less (const struct heap_elem *a,
+						   const struct heap_elem *b,
+						   void *aux UNUSED)
+{
+	struct thread *thread_a = heap_entry(a, struct semaphore_elem, elem)->thread;
+	struct thread *thread_b = heap_entry(b, struct semaphore_elem, elem)->thread;
+	return thread_a->priority < thread_b->priority;
+}
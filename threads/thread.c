@@ -4,11 +4,14 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
 #include "threads/fixed-point.h"
@@ -154,10 +157,11 @@ thread_start (void) {
 	sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick, with
+   IF_ the interrupted frame.  Thus, this function runs in an
+   external interrupt context. */
 void
-thread_tick (void) {
+thread_tick (const struct intr_frame *if_) {
 	struct thread *t = thread_current ();
 
 	/* Update statistics. */
@@ -170,6 +174,13 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+	if (t != idle_thread) {
+		if (if_->cs == SEL_UCSEG)
+			t->rusage.user_ticks++;
+		else
+			t->rusage.kernel_ticks++;
+	}
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
@@ -214,7 +225,7 @@ thread_create (const char *name, int priority,
 	init_thread (t, name, priority);
 
 #ifdef USERPROG
-	if(!stdio_init(t))
+	if(!fd_table_init_stdio(&t->fds))
 		return TID_ERROR;
 #endif
 
@@ -270,8 +281,10 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
+	trace_record (TRACE_WAKEUP, running_thread ()->tid, t->tid, 0);
 	list_insert_ordered(&ready_list, &t->elem, thread_priority_more, NULL);
 	t->status = THREAD_READY;
+	t->ready_ticks = timer_ticks ();
 	intr_set_level (old_level);
 }
 
@@ -320,7 +333,7 @@ thread_exit (void) {
 	/* release all holding lock */
 	while(!list_empty(&curr->locks))
 	{
-		e = list_pop_front(&curr->locks);
+		e = list_front(&curr->locks);
 		struct lock *lock = list_entry(e, struct lock, lockelem);
 		lock_release(lock);
 	}
@@ -345,8 +358,10 @@ thread_yield(void) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
+	if (curr != idle_thread) {
 		list_insert_ordered(&ready_list, &curr->elem, thread_priority_more, 0);
+		curr->ready_ticks = timer_ticks ();
+	}
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
@@ -494,10 +509,10 @@ init_thread (struct thread *t, const char *name, int priority) {
 	list_push_back(&all_list, &t->allelem);	/* Add allelem to all_list. */
 	intr_set_level(old_level);
 
-	list_init(&t->donor_list);     /* implement Priority Donation */
-	list_init(&t->locks);
+	list_init(&t->locks);          /* implement Priority Donation */
 	t->original_priority = priority;
 	t->wait_for_what_lock = NULL;
+	t->wait_queue = NULL;
 	t->magic = THREAD_MAGIC;
 
 #ifdef USERPROG
@@ -505,17 +520,12 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->data_bank = NULL;	
 	list_init(&t->child_list);
 	
-	list_init(&t->fd_list);
-	t->next_fd = 3;
+	fd_table_init(&t->fds);
 	t->running_file = NULL;
-
-	list_init(&t->stdin_list);
-	list_init(&t->stdout_list);
 #endif 
 #ifdef EFILESYS
 	/* TODO: how to initialize cwd */
 	t->cwd = NULL;
-	list_init(&t->dir_list);
 #endif
 
 }
@@ -667,6 +677,17 @@ schedule (void) {
 #endif
 
 	if (curr != next) {
+		trace_record (TRACE_SWITCH, curr->tid, next->tid, curr->status);
+
+		/* Blocking gives up the CPU voluntarily; being switched
+		   out while still ready means we were preempted. */
+		if (curr->status == THREAD_BLOCKED)
+			curr->rusage.voluntary_switches++;
+		else if (curr->status == THREAD_READY)
+			curr->rusage.involuntary_switches++;
+		if (next != idle_thread)
+			next->rusage.wait_ticks += timer_ticks () - next->ready_ticks;
+
 		/* If the thread we switched from is dying, destroy its struct
 		   thread. This must happen late so that thread_exit() doesn't
 		   pull out the rug under itself.
@@ -842,6 +863,7 @@ static void thread_update_priority(struct thread * t)
 	temp1 = DIV_FP_INT(t->recent_cpu, 4);
 	temp1 = SUB_INT_FP((PRI_MAX - (t->nice * 2)), temp1);
 	t->priority = FP_TO_INT(temp1);
+	thread_requeue(t);
 }
 
 /* recalculate priority of all threads */
@@ -857,49 +879,54 @@ void thread_recalculate_priority()
 	}
 }
 
-/* Donate priority to thread, which is locking 'A' that current thread wants to get (while depth < 9) */
+/* Donate priority to thread, which is locking 'A' that current thread wants to get (while depth < 9).
+   Each holder whose priority rises is repositioned in the heap it is blocked on. */
 void priority_donate(struct thread * thread)
 {
 	int depth;
 	struct thread *cur = thread;
+	struct thread *holder;
+
+	ASSERT(intr_get_level() == INTR_OFF);
 
-	int cur_priority = cur->priority;
-	
 	for(depth = 0; depth < DONATION_DEPTH; depth++){     /* nested donation */
 		if(cur->wait_for_what_lock == NULL)
 			break;
-		
-		cur = cur->wait_for_what_lock->holder;
-		
-		if(cur->priority < cur_priority)
-			cur->priority = cur_priority;
+
+		holder = cur->wait_for_what_lock->holder;
+		if(holder == NULL || holder->priority >= cur->priority)
+			break;
+
+		holder->priority = cur->priority;
+		thread_requeue(holder);
+		cur = holder;
 	}
 }
 
-/* After setting thread's priority, update it and compare with max priority in donor_list */
+/* After setting thread's priority, update it to the max of its own priority
+   and the top waiter of every lock it holds. */
 void priority_update(struct thread *thread){
 	struct thread *cur = thread;
+	struct list_elem *e;
+	enum intr_level old_level;
+
+	old_level = intr_disable();
 	cur->priority = cur->original_priority;
 
-	if(list_empty(&cur->donor_list)) return;
-  	list_sort(&cur->donor_list, thread_priority_more, NULL);
-  	int64_t high_priority = list_entry(list_begin(&cur->donor_list), struct thread, donor_elem)->priority;
-  	cur->priority = MAX(high_priority, cur->priority);
+	for(e = list_begin(&cur->locks); e != list_end(&cur->locks); e = list_next(e)){
+		struct heap *waiters = &list_entry(e, struct lock, lockelem)->semaphore.waiters;
+		if(heap_empty(waiters))
+			continue;
+		int high_priority = heap_entry(heap_max(waiters), struct thread, waitelem)->priority;
+		cur->priority = MAX(high_priority, cur->priority);
+	}
+	intr_set_level(old_level);
 }
 
-/* After releasing lock, update unnecessary donor in donor_list */
-void update_donor_lock(struct lock *lock){
-	struct thread *cur = thread_current();
-	struct list_elem *donor = list_begin(&cur->donor_list);
-
-	while (donor != list_end(&cur->donor_list)){
-		struct thread *donor_thread = list_entry(donor, struct thread, donor_elem);
-		if (lock == donor_thread->wait_for_what_lock){
-			donor = list_remove(donor);
-		}
-		else{
-			donor = list_next(donor);
-		}
-	}
+/* Repositions a blocked thread in the wait heap it sleeps on after its priority changed. */
+void thread_requeue(struct thread *thread){
+	ASSERT(intr_get_level() == INTR_OFF);
 
-}
\ No newline at end of file
+	if(thread->wait_queue != NULL)
+		heap_update(thread->wait_queue, thread->wait_queue_elem);
+}
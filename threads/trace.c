@@ -0,0 +1,107 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "intrinsic.h"
+
+/* Scheduler trace buffer.
+
+   A fixed ring of the most recent scheduler, lock, page fault and
+   system call events, each stamped with the time stamp counter.
+   Recording never sleeps and never takes a lock, so it is safe
+   from schedule() and from interrupt handlers: Pintos runs on a
+   single CPU, so disabling interrupts for the few stores that
+   claim and fill a slot is all the exclusion a writer needs.
+
+   trace_dump() prints the ring over the console, which includes
+   the serial port.  utils/trace2json turns that output into the
+   Chrome trace event format. */
+
+/* Number of events kept.  Must be a power of 2. */
+#define TRACE_SIZE 2048
+
+/* A recorded event. */
+struct trace_event {
+	uint64_t tsc;               /* Time stamp counter. */
+	uint64_t a, b;              /* Event-specific arguments. */
+	int32_t tid;                /* Running thread. */
+	uint32_t type;              /* An enum trace_type. */
+};
+
+static struct trace_event events[TRACE_SIZE];
+
+/* Number of events ever recorded.  The newest event is in
+   events[(event_cnt - 1) % TRACE_SIZE]. */
+static uint64_t event_cnt;
+
+/* False while the ring is being dumped. */
+static bool enabled = true;
+
+/* TSC and timer ticks at trace_init(), for calibration. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+static const char *type_names[TRACE_TYPE_CNT] = {
+	"switch", "wakeup", "contend", "fault", "syscall",
+};
+
+/* Records the starting point that trace_dump() uses to relate TSC
+   values to wall-clock time.  Must be called after timer_init(). */
+void
+trace_init (void) {
+	start_tsc = rdtsc ();
+	start_ticks = timer_ticks ();
+}
+
+/* Appends an event of TYPE on behalf of thread TID, with arguments
+   A and B, overwriting the oldest event if the ring is full. */
+void
+trace_record (enum trace_type type, int tid, uint64_t a, uint64_t b) {
+	enum intr_level old_level = intr_disable ();
+
+	if (enabled) {
+		struct trace_event *e = &events[event_cnt++ % TRACE_SIZE];
+		e->tsc = rdtsc ();
+		e->tid = tid;
+		e->type = type;
+		e->a = a;
+		e->b = b;
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints every event in the ring, oldest first.  Recording is
+   paused meanwhile so that the dump is a consistent snapshot. */
+void
+trace_dump (void) {
+	enum intr_level old_level;
+	uint64_t first, last, i;
+	uint64_t cycles_per_us = 0;
+	int64_t elapsed;
+
+	old_level = intr_disable ();
+	enabled = false;
+	last = event_cnt;
+	intr_set_level (old_level);
+
+	first = last > TRACE_SIZE ? last - TRACE_SIZE : 0;
+	elapsed = timer_elapsed (start_ticks);
+	if (elapsed > 0)
+		cycles_per_us = (rdtsc () - start_tsc)
+			/ (elapsed * (1000000 / TIMER_FREQ));
+
+	printf ("trace: begin %llu events, %llu dropped, %llu cycles/us\n",
+			last - first, first, cycles_per_us);
+	for (i = first; i < last; i++) {
+		const struct trace_event *e = &events[i % TRACE_SIZE];
+		printf ("trace: %llu %s %d %#llx %#llx\n",
+				e->tsc, type_names[e->type], e->tid, e->a, e->b);
+	}
+	printf ("trace: end\n");
+
+	old_level = intr_disable ();
+	enabled = true;
+	intr_set_level (old_level);
+}
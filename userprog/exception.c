@@ -4,14 +4,25 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "intrinsic.h"
 #include "threads/vaddr.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* An entry in the exception table in uaccess.S: a kernel
+   instruction allowed to fault on user memory, and where to resume
+   if it does. */
+struct exception_entry {
+	uintptr_t insn;
+	uintptr_t fixup;
+};
+extern const struct exception_entry __ex_table_start[], __ex_table_end[];
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static bool fixup_exception (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -144,7 +155,10 @@ page_fault (struct intr_frame *f) {
 	not_present = (f->error_code & PF_P) == 0;
 	write = (f->error_code & PF_W) != 0;
 	user = (f->error_code & PF_U) != 0;
-	
+	thread_current ()->rusage.page_faults++;
+	trace_record (TRACE_FAULT, thread_current ()->tid,
+			(uint64_t) fault_addr, f->error_code);
+
 #ifdef VM
 	/* For project 3 and later. */
 	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
@@ -154,6 +168,11 @@ page_fault (struct intr_frame *f) {
 	/* Count page faults. */
 	page_fault_cnt++;
 
+	/* A bad user pointer handed to one of the user copy routines
+	   is the process's mistake, not a kernel bug. */
+	if (!user && fixup_exception (f))
+		return;
+
 	/* If the fault is true fault, show info and exit. */
 	/* printf ("Page fault at %p: %s error %s page in %s context.\n",
 			fault_addr,
@@ -163,3 +182,18 @@ page_fault (struct intr_frame *f) {
 	kill (f);
 }
 
+
+/* If F faulted at an instruction in the exception table, arranges
+   for it to resume at the instruction's fixup and returns true.
+   Otherwise returns false. */
+static bool
+fixup_exception (struct intr_frame *f) {
+	const struct exception_entry *e;
+
+	for (e = __ex_table_start; e < __ex_table_end; e++)
+		if (e->insn == f->rip) {
+			f->rip = e->fixup;
+			return true;
+		}
+	return false;
+}
@@ -0,0 +1,193 @@
+#include "userprog/execcache.h"
+#include <debug.h>
+#include <stddef.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Executable image cache.
+
+   Loading a program means reading its ELF header and program
+   headers and checking every loadable segment before mapping any
+   of them.  A program that is run over and over goes through the
+   same work each time, so the result is kept here, keyed by the
+   executable's inode, for the few executables run most recently.
+
+   The file system calls exec_cache_invalidate() whenever an inode
+   is written or freed, which drops that inode's image.  Writes to
+   inodes with no image return after a glance at CACHED_MASK,
+   without taking the lock.  A load that missed reads the headers
+   without holding any lock here, so it may race with a write to
+   its inode; the file system bumps the inode's change sequence
+   number before every invalidation, and an image is only inserted
+   if that number has not moved since the miss. */
+
+/* Maximum number of cached images. */
+#define EXEC_CACHE_SIZE 16
+
+/* Cached images, most recently used first. */
+static struct list images;
+static int image_cnt;
+
+/* Bit INUMBER % 64 is set if an image of INUMBER may be cached.
+   Written with exec_cache_lock held, but read without it. */
+static uint64_t cached_mask;
+
+/* Guards the variables above and every image's REFCNT. */
+static struct lock exec_cache_lock;
+
+static void exec_cache_invalidate (disk_sector_t inumber);
+
+/* Initializes the cache and hooks it to the file system. */
+void
+exec_cache_init (void) {
+	list_init (&images);
+	lock_init (&exec_cache_lock);
+	inode_set_change_func (exec_cache_invalidate);
+}
+
+/* Returns a new image of INUMBER with room for SEG_CNT segments
+   and one reference for the caller, or a null pointer if memory is
+   exhausted. */
+struct exec_image *
+exec_image_create (disk_sector_t inumber, int seg_cnt) {
+	struct exec_image *img;
+
+	img = malloc (sizeof *img + seg_cnt * sizeof *img->segs);
+	if (img == NULL)
+		return NULL;
+	img->inumber = inumber;
+	img->entry = 0;
+	img->refcnt = 1;
+	img->seg_cnt = seg_cnt;
+	return img;
+}
+
+/* Returns INUMBER's bit in cached_mask. */
+static uint64_t
+mask_bit (disk_sector_t inumber) {
+	return (uint64_t) 1 << (inumber % 64);
+}
+
+/* Recomputes cached_mask after images have been removed, with
+   exec_cache_lock held. */
+static void
+update_mask (void) {
+	uint64_t mask = 0;
+	struct list_elem *e;
+
+	for (e = list_begin (&images); e != list_end (&images);
+			e = list_next (e))
+		mask |= mask_bit (list_entry (e, struct exec_image, elem)->inumber);
+	cached_mask = mask;
+}
+
+/* Drops a reference to IMG, with exec_cache_lock held, and returns
+   IMG if that was the last one, so the caller can free it once the
+   lock is released. */
+static struct exec_image *
+put_locked (struct exec_image *img) {
+	ASSERT (img->refcnt > 0);
+	return --img->refcnt == 0 ? img : NULL;
+}
+
+/* Drops a reference to IMG, freeing it with the last one. */
+void
+exec_image_put (struct exec_image *img) {
+	lock_acquire (&exec_cache_lock);
+	img = put_locked (img);
+	lock_release (&exec_cache_lock);
+	free (img);
+}
+
+/* Looks up the image of open INODE.  Returns it with a new
+   reference for the caller, or a null pointer if it is not cached,
+   in which case *SEQ is set for passing to exec_cache_insert(). */
+struct exec_image *
+exec_cache_lookup (struct inode *inode, uint64_t *seq) {
+	disk_sector_t inumber = inode_get_inumber (inode);
+	struct list_elem *e;
+
+	lock_acquire (&exec_cache_lock);
+	for (e = list_begin (&images); e != list_end (&images);
+			e = list_next (e)) {
+		struct exec_image *img = list_entry (e, struct exec_image, elem);
+
+		if (img->inumber == inumber) {
+			list_remove (e);
+			list_push_front (&images, e);
+			img->refcnt++;
+			lock_release (&exec_cache_lock);
+			return img;
+		}
+	}
+	*seq = inode_change_seq (inode);
+	lock_release (&exec_cache_lock);
+	return NULL;
+}
+
+/* Adds IMG, which the caller read from open INODE after
+   exec_cache_lookup() set SEQ, to the cache, evicting the least
+   recently used image if the cache is full.  Does nothing if INODE
+   has changed in the meantime or is cached already.  The caller
+   keeps its reference. */
+void
+exec_cache_insert (struct exec_image *img, struct inode *inode,
+		uint64_t seq) {
+	struct exec_image *victim = NULL;
+	struct list_elem *e;
+
+	lock_acquire (&exec_cache_lock);
+
+	/* Set the bit before checking SEQ: a write that bumps INODE's
+	   number after the check then sees the bit and drops IMG. */
+	cached_mask |= mask_bit (img->inumber);
+	barrier ();
+	if (seq != inode_change_seq (inode))
+		goto done;
+	for (e = list_begin (&images); e != list_end (&images);
+			e = list_next (e))
+		if (list_entry (e, struct exec_image, elem)->inumber == img->inumber)
+			goto done;
+
+	if (image_cnt == EXEC_CACHE_SIZE) {
+		victim = list_entry (list_pop_back (&images), struct exec_image, elem);
+		victim = put_locked (victim);
+		image_cnt--;
+		update_mask ();
+	}
+	img->refcnt++;
+	list_push_front (&images, &img->elem);
+	image_cnt++;
+
+done:
+	lock_release (&exec_cache_lock);
+	free (victim);
+}
+
+/* Drops the image of INUMBER, whose contents have changed or
+   which has been freed. */
+static void
+exec_cache_invalidate (disk_sector_t inumber) {
+	struct exec_image *victim = NULL;
+	struct list_elem *e;
+
+	if (!(cached_mask & mask_bit (inumber)))
+		return;
+
+	lock_acquire (&exec_cache_lock);
+	for (e = list_begin (&images); e != list_end (&images);
+			e = list_next (e)) {
+		struct exec_image *img = list_entry (e, struct exec_image, elem);
+
+		if (img->inumber == inumber) {
+			list_remove (e);
+			image_cnt--;
+			victim = put_locked (img);
+			update_mask ();
+			break;
+		}
+	}
+	lock_release (&exec_cache_lock);
+	free (victim);
+}
@@ -0,0 +1,364 @@
+#include "userprog/fdtable.h"
+#include <debug.h>
+#include <spawn.h>
+#include <stddef.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "userprog/pipe.h"
+
+/* File descriptor tables.
+
+   A table is an array indexed by fd that grows by doubling, so
+   finding the open file behind an fd is a bounds check and a
+   load.  Slots hold pointers to reference-counted open file
+   objects: open() creates one, dup2() stores another pointer to
+   the same one, and close() drops a reference, closing the
+   underlying file or directory when the last one goes.
+
+   New fds are the lowest free ones at or above FD_FIRST.  The
+   table remembers a bound below which every fd is in use, so
+   opening a file usually needs no search at all. */
+
+/* Initial number of slots in a table. */
+#define FD_INIT_SIZE 16
+
+static struct kmem_cache *open_file_cachep;
+
+/* Bumped by every fd_table_copy(). */
+static uint64_t copy_seq;
+
+/* Creates the slab cache for open file objects. */
+void
+fdtable_init (void) {
+	open_file_cachep = kmem_cache_create ("open_file",
+			sizeof (struct open_file), NULL);
+}
+
+/* Initializes T as an empty table. */
+void
+fd_table_init (struct fd_table *t) {
+	t->fds = NULL;
+	t->size = 0;
+	t->lowest_free = FD_FIRST;
+}
+
+/* Grows T so that it has a slot for FD.  Returns false if memory
+   is exhausted. */
+static bool
+reserve (struct fd_table *t, int fd) {
+	struct open_file **fds;
+	int size;
+
+	if (fd < t->size)
+		return true;
+
+	size = t->size > 0 ? t->size : FD_INIT_SIZE;
+	while (size <= fd)
+		size *= 2;
+	fds = realloc (t->fds, size * sizeof *fds);
+	if (fds == NULL)
+		return false;
+	for (int i = t->size; i < size; i++)
+		fds[i] = NULL;
+	t->fds = fds;
+	t->size = size;
+	return true;
+}
+
+/* Returns a new open file object of TYPE for OBJECT with no
+   references, or a null pointer if memory is exhausted. */
+static struct open_file *
+open_file_create (enum open_file_type type, void *object) {
+	struct open_file *of = kmem_cache_alloc (open_file_cachep);
+	if (of == NULL)
+		return NULL;
+
+	of->type = type;
+	of->file = object;
+	of->refcnt = 0;
+	of->copy = NULL;
+	of->copy_seq = 0;
+	return of;
+}
+
+/* Drops a reference to OF, closing it with the last one. */
+static void
+open_file_put (struct open_file *of) {
+	ASSERT (of->refcnt > 0);
+	if (--of->refcnt > 0)
+		return;
+
+	if (of->type == OPEN_FILE)
+		file_close (of->file);
+	else if (of->type == OPEN_DIR)
+		dir_close (of->dir);
+	else if (of->type == OPEN_PIPE_READ || of->type == OPEN_PIPE_WRITE)
+		pipe_close_end (of->pipe, of->type == OPEN_PIPE_WRITE);
+	kmem_cache_free (open_file_cachep, of);
+}
+
+/* Stores a new reference to OF as FD in T, which must have a
+   free slot for FD. */
+static void
+install (struct fd_table *t, int fd, struct open_file *of) {
+	ASSERT (fd < t->size && t->fds[fd] == NULL);
+
+	of->refcnt++;
+	t->fds[fd] = of;
+	if (fd == t->lowest_free)
+		t->lowest_free++;
+}
+
+/* Returns the lowest free fd in T at or above FD_FIRST, growing T
+   if needed, or -1 if there is none. */
+static int
+alloc_fd (struct fd_table *t) {
+	int fd = t->lowest_free;
+
+	while (fd < t->size && t->fds[fd] != NULL)
+		fd++;
+	t->lowest_free = fd;
+	if (fd >= FD_MAX || !reserve (t, fd))
+		return -1;
+	return fd;
+}
+
+/* Gives T the console: stdin as fd 0 and stdout as fd 1. */
+bool
+fd_table_init_stdio (struct fd_table *t) {
+	struct open_file *in, *out;
+
+	if (!reserve (t, STDERR_FILENO))
+		return false;
+	in = open_file_create (OPEN_STDIN, NULL);
+	out = open_file_create (OPEN_STDOUT, NULL);
+	if (in == NULL || out == NULL) {
+		kmem_cache_free (open_file_cachep, in);
+		kmem_cache_free (open_file_cachep, out);
+		return false;
+	}
+	install (t, STDIN_FILENO, in);
+	install (t, STDOUT_FILENO, out);
+	return true;
+}
+
+/* Returns a new copy of open file object OF, with a file or
+   directory of its own, or a null pointer if memory is exhausted.
+   A pipe is not copied: the copy opens another end of the same
+   pipe. */
+static struct open_file *
+dup_open_file (const struct open_file *of) {
+	struct open_file *copy;
+	void *object = NULL;
+
+	if (of->type == OPEN_FILE) {
+		object = file_duplicate (of->file);
+		if (object == NULL)
+			return NULL;
+	} else if (of->type == OPEN_DIR) {
+		object = dir_reopen (of->dir);
+		if (object == NULL)
+			return NULL;
+	} else if (of->type == OPEN_PIPE_READ || of->type == OPEN_PIPE_WRITE) {
+		object = of->pipe;
+		pipe_open_end (object, of->type == OPEN_PIPE_WRITE);
+	}
+
+	copy = open_file_create (of->type, object);
+	if (copy == NULL) {
+		if (of->type == OPEN_FILE)
+			file_close (object);
+		else if (of->type == OPEN_DIR)
+			dir_close (object);
+		else if (of->type == OPEN_PIPE_READ || of->type == OPEN_PIPE_WRITE)
+			pipe_close_end (object, of->type == OPEN_PIPE_WRITE);
+		return NULL;
+	}
+	return copy;
+}
+
+/* Makes a copy of SRC's object OF for the table being built by
+   fork sequence SEQ, or returns the copy already made for an
+   earlier fd.  Returns a null pointer if memory is exhausted. */
+static struct open_file *
+copy_open_file (struct open_file *of, uint64_t seq) {
+	struct open_file *copy;
+
+	if (of->copy_seq == seq)
+		return of->copy;
+
+	copy = dup_open_file (of);
+	if (copy == NULL)
+		return NULL;
+	of->copy = copy;
+	of->copy_seq = seq;
+	return copy;
+}
+
+/* Fills empty table DST with copies of the open files in SRC, in
+   a single pass.  Fds that share an object in SRC share its copy
+   in DST.  Returns false if memory is exhausted, in which case DST
+   holds some of the copies and should be destroyed. */
+bool
+fd_table_copy (struct fd_table *dst, const struct fd_table *src) {
+	uint64_t seq;
+
+	ASSERT (dst->size == 0);
+
+	if (src->size == 0)
+		return true;
+	if (!reserve (dst, src->size - 1))
+		return false;
+
+	enum intr_level old_level = intr_disable ();
+	seq = ++copy_seq;
+	intr_set_level (old_level);
+
+	for (int fd = 0; fd < src->size; fd++) {
+		struct open_file *of = src->fds[fd], *copy;
+
+		if (of == NULL)
+			continue;
+		copy = copy_open_file (of, seq);
+		if (copy == NULL)
+			return false;
+		install (dst, fd, copy);
+	}
+	dst->lowest_free = src->lowest_free;
+	return true;
+}
+
+/* Carries out the CNT spawn actions in FDS on DST, copying open
+   files from SRC.  Every action makes its own copy, so unlike
+   fd_table_copy(), two child fds made from one parent fd do not
+   share a file position.  Returns false if some PARENT_FD is not
+   open, some CHILD_FD is out of range, or memory is exhausted, in
+   which case DST holds the copies made so far and should be
+   destroyed. */
+bool
+fd_table_inherit (struct fd_table *dst, const struct fd_table *src,
+		const struct spawn_fd *fds, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		struct open_file *of, *copy;
+		int fd = fds[i].child_fd;
+
+		if (fd < 0 || fd >= FD_MAX)
+			return false;
+		if (fds[i].parent_fd == -1) {
+			fd_close (dst, fd);
+			continue;
+		}
+
+		of = fd_get (src, fds[i].parent_fd);
+		if (of == NULL || !reserve (dst, fd))
+			return false;
+		copy = dup_open_file (of);
+		if (copy == NULL)
+			return false;
+		fd_close (dst, fd);
+		install (dst, fd, copy);
+	}
+	return true;
+}
+
+/* Closes every fd in T and frees its storage, leaving T empty. */
+void
+fd_table_destroy (struct fd_table *t) {
+	for (int fd = 0; fd < t->size; fd++)
+		if (t->fds[fd] != NULL)
+			open_file_put (t->fds[fd]);
+	free (t->fds);
+	fd_table_init (t);
+}
+
+/* Opens a new fd in T for OBJECT, an open struct file, struct dir
+   or pipe end as given by TYPE, taking ownership of it.  Returns
+   the fd, or -1 on failure, in which case OBJECT is still the
+   caller's. */
+int
+fd_open (struct fd_table *t, enum open_file_type type, void *object) {
+	struct open_file *of;
+	int fd;
+
+	fd = alloc_fd (t);
+	if (fd < 0)
+		return -1;
+	of = open_file_create (type, object);
+	if (of == NULL)
+		return -1;
+	install (t, fd, of);
+	return fd;
+}
+
+/* Returns the open file object for FD in T, or a null pointer if
+   FD is not open. */
+struct open_file *
+fd_get (const struct fd_table *t, int fd) {
+	if (fd < 0 || fd >= t->size)
+		return NULL;
+	return t->fds[fd];
+}
+
+/* Returns the file open as FD in T, or a null pointer if FD is
+   not an open regular file. */
+struct file *
+fd_get_file (const struct fd_table *t, int fd) {
+	struct open_file *of = fd_get (t, fd);
+	return of != NULL && of->type == OPEN_FILE ? of->file : NULL;
+}
+
+/* Returns the directory open as FD in T, or a null pointer if FD
+   is not an open directory. */
+struct dir *
+fd_get_dir (const struct fd_table *t, int fd) {
+	struct open_file *of = fd_get (t, fd);
+	return of != NULL && of->type == OPEN_DIR ? of->dir : NULL;
+}
+
+/* Returns the pipe whose write end, if WRITE, or read end is open
+   as FD in T, or a null pointer if FD is not such an end. */
+struct pipe *
+fd_get_pipe (const struct fd_table *t, int fd, bool write) {
+	struct open_file *of = fd_get (t, fd);
+	enum open_file_type type = write ? OPEN_PIPE_WRITE : OPEN_PIPE_READ;
+	return of != NULL && of->type == type ? of->pipe : NULL;
+}
+
+/* Closes FD in T.  Returns false if FD was not open. */
+bool
+fd_close (struct fd_table *t, int fd) {
+	struct open_file *of = fd_get (t, fd);
+
+	if (of == NULL)
+		return false;
+	t->fds[fd] = NULL;
+	if (fd >= FD_FIRST && fd < t->lowest_free)
+		t->lowest_free = fd;
+	open_file_put (of);
+	return true;
+}
+
+/* Makes NEWFD in T refer to the same open file object as OLDFD,
+   closing NEWFD first if it is open.  Returns NEWFD, or -1 if
+   OLDFD is not open or NEWFD is out of range. */
+int
+fd_dup2 (struct fd_table *t, int oldfd, int newfd) {
+	struct open_file *of = fd_get (t, oldfd);
+
+	if (of == NULL || newfd < 0 || newfd >= FD_MAX)
+		return -1;
+	if (oldfd == newfd)
+		return newfd;
+	if (!reserve (t, newfd))
+		return -1;
+
+	/* Hold OF while NEWFD is closed, in case they share it. */
+	of->refcnt++;
+	fd_close (t, newfd);
+	install (t, newfd, of);
+	of->refcnt--;
+	return newfd;
+}
@@ -0,0 +1,332 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Pipes.
+
+   A pipe is a one-page ring buffer in the kernel.  Writers copy
+   into it and readers copy out of it, each waiting on a condition
+   variable while the ring is full or empty.  Every open read or
+   write end, in whatever process, counts toward the pipe's
+   READERS or WRITERS; the pipe goes away with the last end.
+
+   Pushing a large write through the ring costs two copies and a
+   trip through the scheduler for every page.  A write of at least
+   PIPE_DIRECT_MIN bytes instead waits for the ring to drain, pins
+   its own buffer, and offers it to readers, who copy straight out
+   of the writer's frames into their own buffers until it has all
+   been taken.  Only one write is in progress at a time, so data
+   arrives in the order it was written. */
+
+/* Size of the ring buffer. */
+#define PIPE_SIZE PGSIZE
+
+/* Writes at least this long bypass the ring. */
+#define PIPE_DIRECT_MIN PGSIZE
+
+/* Most bytes of a writer's buffer pinned at once. */
+#define PIPE_DIRECT_MAX (16 * PGSIZE)
+
+struct pipe {
+	struct lock lock;           /* Guards the members below. */
+	struct condition readable;  /* Data arrived or last writer left. */
+	struct condition writable;  /* Data taken or last reader left. */
+	uint8_t *buf;               /* Ring of PIPE_SIZE bytes. */
+	uint32_t head;              /* Bytes ever read from BUF. */
+	uint32_t tail;              /* Bytes ever written to BUF. */
+	int readers;                /* Open read ends. */
+	int writers;                /* Open write ends. */
+
+	/* Writer's buffer on offer, if DIRECT_LEN is nonzero. */
+	uint64_t *direct_pml4;      /* Writer's page table. */
+	const uint8_t *direct_buf;  /* Next byte to take. */
+	size_t direct_len;          /* Bytes left to take. */
+
+	/* Held for the whole of a write, so writes do not mix. */
+	struct lock write_lock;
+};
+
+static struct kmem_cache *pipe_cachep;
+
+/* Creates the slab cache for pipes. */
+void
+pipe_init (void) {
+	pipe_cachep = kmem_cache_create ("pipe", sizeof (struct pipe), NULL);
+}
+
+/* Returns a new, empty pipe with one read end and one write end
+   open, or a null pointer if memory is exhausted. */
+struct pipe *
+pipe_create (void) {
+	struct pipe *p = kmem_cache_alloc (pipe_cachep);
+	if (p == NULL)
+		return NULL;
+
+	p->buf = palloc_get_page (0);
+	if (p->buf == NULL) {
+		kmem_cache_free (pipe_cachep, p);
+		return NULL;
+	}
+	lock_init (&p->lock);
+	cond_init (&p->readable);
+	cond_init (&p->writable);
+	p->head = p->tail = 0;
+	p->readers = p->writers = 1;
+	p->direct_pml4 = NULL;
+	p->direct_buf = NULL;
+	p->direct_len = 0;
+	lock_init (&p->write_lock);
+	return p;
+}
+
+/* Opens another read end of P, or write end if WRITE. */
+void
+pipe_open_end (struct pipe *p, bool write) {
+	lock_acquire (&p->lock);
+	if (write)
+		p->writers++;
+	else
+		p->readers++;
+	lock_release (&p->lock);
+}
+
+/* Closes a read end of P, or write end if WRITE, freeing P when no
+   end is left open.  Closing the last write end gives readers end
+   of file; closing the last read end makes writes fail. */
+void
+pipe_close_end (struct pipe *p, bool write) {
+	bool last;
+
+	lock_acquire (&p->lock);
+	if (write) {
+		ASSERT (p->writers > 0);
+		if (--p->writers == 0)
+			cond_broadcast (&p->readable, &p->lock);
+	} else {
+		ASSERT (p->readers > 0);
+		if (--p->readers == 0)
+			cond_broadcast (&p->writable, &p->lock);
+	}
+	last = p->readers == 0 && p->writers == 0;
+	lock_release (&p->lock);
+
+	if (last) {
+		palloc_free_page (p->buf);
+		kmem_cache_free (pipe_cachep, p);
+	}
+}
+
+/* Pins the SIZE bytes of user memory at UADDR, which the caller has
+   checked are readable.  Without VM, user pages never move. */
+static bool
+pin (const void *uaddr UNUSED, size_t size UNUSED) {
+#ifdef VM
+	return vm_pin_buffer (uaddr, size, false);
+#else
+	return true;
+#endif
+}
+
+/* Undoes pin(). */
+static void
+unpin (const void *uaddr UNUSED, size_t size UNUSED) {
+#ifdef VM
+	vm_unpin_buffer (uaddr, size);
+#endif
+}
+
+/* Copies up to SIZE bytes out of P's ring to user address UDST,
+   with P's lock held.  Returns the number of bytes copied, which is
+   short if UDST is not writable. */
+static size_t
+ring_get (struct pipe *p, uint8_t *udst, size_t size) {
+	size_t used = p->tail - p->head;
+	size_t done = 0;
+
+	if (size > used)
+		size = used;
+	while (done < size) {
+		size_t ofs = p->head % PIPE_SIZE;
+		size_t chunk = size - done;
+
+		if (chunk > PIPE_SIZE - ofs)
+			chunk = PIPE_SIZE - ofs;
+		if (!copy_to_user (udst + done, p->buf + ofs, chunk))
+			break;
+		p->head += chunk;
+		done += chunk;
+	}
+	return done;
+}
+
+/* Copies up to SIZE bytes from user address USRC into P's ring,
+   with P's lock held.  Returns the number of bytes copied, which is
+   short if the ring fills or USRC is not readable. */
+static size_t
+ring_put (struct pipe *p, const uint8_t *usrc, size_t size) {
+	size_t room = PIPE_SIZE - (p->tail - p->head);
+	size_t done = 0;
+
+	if (size > room)
+		size = room;
+	while (done < size) {
+		size_t ofs = p->tail % PIPE_SIZE;
+		size_t chunk = size - done;
+
+		if (chunk > PIPE_SIZE - ofs)
+			chunk = PIPE_SIZE - ofs;
+		if (!copy_from_user (p->buf + ofs, usrc + done, chunk))
+			break;
+		p->tail += chunk;
+		done += chunk;
+	}
+	return done;
+}
+
+/* Copies up to SIZE bytes of the writer's buffer on offer in P to
+   user address UDST, with P's lock held, a page of the writer's
+   buffer at a time.  Returns the number of bytes copied, which is
+   short if UDST is not writable. */
+static size_t
+direct_get (struct pipe *p, uint8_t *udst, size_t size) {
+	size_t done = 0;
+
+	while (done < size && p->direct_len > 0) {
+		const uint8_t *src = p->direct_buf;
+		size_t chunk = PGSIZE - pg_ofs (src);
+		void *kva;
+
+		if (chunk > size - done)
+			chunk = size - done;
+		if (chunk > p->direct_len)
+			chunk = p->direct_len;
+
+		/* The writer's page is pinned, so it is mapped. */
+		kva = pml4_get_page (p->direct_pml4, src);
+		ASSERT (kva != NULL);
+		if (!copy_to_user (udst + done, kva, chunk))
+			break;
+		p->direct_buf += chunk;
+		p->direct_len -= chunk;
+		done += chunk;
+	}
+	return done;
+}
+
+/* Reads up to SIZE bytes from P into user buffer UDST, waiting
+   until there is something to read.  Returns the number of bytes
+   read, 0 at end of file, or -1 if UDST is not writable. */
+int
+pipe_read (struct pipe *p, void *udst, size_t size) {
+	size_t n;
+
+	if (size == 0)
+		return 0;
+
+	lock_acquire (&p->lock);
+	while (p->tail == p->head && p->direct_len == 0 && p->writers > 0)
+		cond_wait (&p->readable, &p->lock);
+
+	/* The ring is empty whenever a buffer is on offer. */
+	if (p->tail != p->head)
+		n = ring_get (p, udst, size);
+	else if (p->direct_len > 0)
+		n = direct_get (p, udst, size);
+	else {
+		lock_release (&p->lock);
+		return 0;
+	}
+	if (n > 0)
+		cond_broadcast (&p->writable, &p->lock);
+	lock_release (&p->lock);
+
+	return n > 0 ? (int) n : -1;
+}
+
+/* Offers the SIZE bytes at USRC, which are pinned, to P's readers
+   and waits until they have all been taken or the last reader has
+   gone, with P's lock held.  Returns the number of bytes taken. */
+static size_t
+direct_put (struct pipe *p, const uint8_t *usrc, size_t size) {
+	size_t left;
+
+	p->direct_pml4 = thread_current ()->pml4;
+	p->direct_buf = usrc;
+	p->direct_len = size;
+	cond_broadcast (&p->readable, &p->lock);
+	while (p->direct_len > 0 && p->readers > 0)
+		cond_wait (&p->writable, &p->lock);
+
+	left = p->direct_len;
+	p->direct_len = 0;
+	return size - left;
+}
+
+/* Writes the SIZE bytes of user buffer USRC to P, waiting for
+   readers to make room as needed.  Returns the number of bytes
+   written, which is short only if the last reader goes away or
+   USRC is not readable, or -1 if nothing could be written. */
+int
+pipe_write (struct pipe *p, const void *usrc, size_t size) {
+	const uint8_t *src = usrc;
+	size_t done = 0;
+
+	if (size == 0)
+		return 0;
+
+	lock_acquire (&p->write_lock);
+	lock_acquire (&p->lock);
+	while (done < size && p->readers > 0) {
+		size_t left = size - done;
+		size_t n;
+
+		if (left >= PIPE_DIRECT_MIN) {
+			size_t chunk = left < PIPE_DIRECT_MAX ? left : PIPE_DIRECT_MAX;
+			bool pinned;
+
+			/* Let readers drain the ring first. */
+			while (p->tail != p->head && p->readers > 0)
+				cond_wait (&p->writable, &p->lock);
+			if (p->readers == 0)
+				break;
+
+			/* Pinning may fault pages in, so don't hold up
+			   readers meanwhile.  WRITE_LOCK keeps other
+			   writers out of the ring. */
+			lock_release (&p->lock);
+			pinned = pin (src + done, chunk);
+			lock_acquire (&p->lock);
+
+			if (pinned) {
+				n = direct_put (p, src + done, chunk);
+				unpin (src + done, chunk);
+				done += n;
+				continue;
+			}
+		}
+
+		while (p->tail - p->head == PIPE_SIZE && p->readers > 0)
+			cond_wait (&p->writable, &p->lock);
+		if (p->readers == 0)
+			break;
+		n = ring_put (p, src + done, left);
+		if (n == 0)
+			break;
+		done += n;
+		cond_broadcast (&p->readable, &p->lock);
+	}
+	lock_release (&p->lock);
+	lock_release (&p->write_lock);
+
+	return done > 0 ? (int) done : -1;
+}
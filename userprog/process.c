@@ -10,14 +10,18 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
+#include "userprog/execcache.h"
 #include "userprog/syscall.h"
 #include "threads/synch.h"
 #include <list.h>
@@ -33,6 +37,7 @@ static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
+static void __do_spawn (void *);
 
 static void
 construct_stack(struct intr_frame *if_, int argc, char ** argv);
@@ -50,6 +55,7 @@ process_data_bank_init (struct process_data_bank *bank) {
 
 	bank->init_mark = true;
 	bank->fork_succ = false;
+	bank->spawn_mark = false;
 	bank->exit_mark = false;
 	bank->wait_mark = false;
     bank->orphan = false;
@@ -64,6 +70,10 @@ process_data_bank_init (struct process_data_bank *bank) {
 	/* auxiliary data, used when process_fork */
 	bank->parent = NULL;
 	bank->parent_if = NULL;
+
+	/* auxiliary data, used when process_spawn */
+	bank->spawn_fds = NULL;
+	bank->spawn_fd_cnt = 0;
 	return true;
 }
 
@@ -259,22 +269,6 @@ __do_fork (void *aux) {
 	else
 		current->cwd = dir_open_root();
 
-	/* duplicate dir_desc object */
-	if(!list_empty(&parent->dir_list))
-	{
-		struct list_elem *e;
-		for(e = list_front(&parent->dir_list); e != list_end(&parent->dir_list); e = list_next(e))
-		{
-			struct dir_desc *parent_desc = list_entry(e, struct dir_desc, elem);
-			struct dir_desc *curr_desc = (struct dir_desc *)palloc_get_page(0);
-			if(curr_desc == NULL)
-				goto error;
-			
-			curr_desc->fd = parent_desc->fd;
-			curr_desc->dir = dir_reopen(parent_desc->dir);
-			list_push_back(&current->dir_list, &curr_desc->elem);
-		}
-	}
 #endif	
 	
 	/* 1. Read the cpu context to local stack. */
@@ -301,90 +295,15 @@ __do_fork (void *aux) {
 	 * TODO:       in include/filesys/file.h. Note that parent should not return
 	 * TODO:       from the fork() until this function successfully duplicates
 	 * TODO:       the resources of parent.*/
-	struct list_elem *e;
-	struct list_elem *e1;
-	struct fd_t *parent_fd_t;
-	struct fd *trash;
-
-	/* initialize, due to stdio_init */
-	while(!list_empty(&current->stdin_list))
-	{
-		e = list_pop_front(&current->stdin_list);
-		trash = list_entry(e, struct fd, elem);
-		palloc_free_page(trash);
-	}
-
-	while(!list_empty(&current->stdout_list))
-	{
-		e = list_pop_front(&current->stdout_list);
-		trash = list_entry(e, struct fd, elem);
-		palloc_free_page(trash);
-	}
-
-	if(!list_empty(&parent->stdin_list))
-	{
-		for(e = list_front(&parent->stdin_list); e != list_end(&parent->stdin_list); e = list_next(e))
-		{
-			struct fd *parent_fd_num = list_entry(e, struct fd, elem);
-			struct fd *curr_fd_num = palloc_get_page(0);
-			if(curr_fd_num == NULL)
-				goto error;
-			
-			curr_fd_num->fd = parent_fd_num->fd;
-			list_push_back(&current->stdin_list, &curr_fd_num->elem);
-		}
-	}
-
-	if(!list_empty(&parent->stdout_list))
-	{
-		for(e = list_front(&parent->stdout_list); e != list_end(&parent->stdout_list); e = list_next(e))
-		{
-			struct fd *parent_fd_num = list_entry(e, struct fd, elem);
-			struct fd *curr_fd_num = palloc_get_page(0);
-			if(curr_fd_num == NULL)
-				goto error;
-			
-			curr_fd_num->fd = parent_fd_num->fd;
-			list_push_back(&current->stdout_list, &curr_fd_num->elem);
-		}
-	}
-
-	if(!list_empty(&parent->fd_list))
-	{
-		for(e = list_front(&parent->fd_list); e != list_end(&parent->fd_list); e = list_next(e))
-		{
-			parent_fd_t = list_entry(e, struct fd_t, elem);
-			struct fd_t *curr_fd_t = palloc_get_page(0);
-			if(curr_fd_t == NULL)
-				goto error;
-				
-			curr_fd_t->file = file_duplicate(parent_fd_t->file);
-			if(curr_fd_t->file == NULL)
-			{
-				palloc_free_page(curr_fd_t);
-				goto error;
-			}
-			
-			list_init(&curr_fd_t->dup2_list);
-			list_push_back(&current->fd_list, &curr_fd_t->elem);
-
-			if(!list_empty(&parent_fd_t->dup2_list))
-			{
-				for(e1 = list_front(&parent_fd_t->dup2_list); e1 != list_end(&parent_fd_t->dup2_list);
-				e1 = list_next(e1))
-				{
-					struct fd *parent_fd_num = list_entry(e1, struct fd, elem);
-					struct fd *curr_fd_num = palloc_get_page(0);
-					if(curr_fd_num == NULL)
-						goto error;
-
-					curr_fd_num->fd = parent_fd_num->fd;
-					list_push_back(&curr_fd_t->dup2_list, &curr_fd_num->elem);
-				}
-			}
-		}
-	}
-	current->next_fd = parent->next_fd;
+	/* The ring lives in memory we just copied, at the same address. */
+	current->ring = parent->ring;
+	current->ring_entries = parent->ring_entries;
+
+	/* Replace the console fds that thread_create() gave us with
+	 * copies of all of the parent's. */
+	fd_table_destroy(&current->fds);
+	if(!fd_table_copy(&current->fds, &parent->fds))
+		goto error;
 	/* Concern: running_file duplicate ?? */
 	
 	/* Finally, switch to the newly created process. */
@@ -400,6 +319,99 @@ error:
 	thread_exit ();		/* free all resource of above stage */
 }
 
+/* Starts a new process running CMDLINE, as exec() would, without
+ * copying the current process first.  The child inherits only the
+ * working directory and the fds that the FD_CNT actions in FDS give
+ * it.  CMDLINE and FDS must be kernel memory; they are no longer
+ * needed once this returns.  Returns the new process's thread id,
+ * or TID_ERROR if the process cannot be created or its program
+ * cannot be loaded. */
+tid_t
+process_spawn (const char *cmdline, const struct spawn_fd *fds, int fd_cnt) {
+	struct thread *parent = thread_current();
+	struct process_data_bank *child_bank = NULL;
+	char name[16];
+	size_t len;
+
+	/* make process_memory_block */
+	child_bank = palloc_get_page(PAL_USER | PAL_ZERO);
+	if(child_bank == NULL)
+		goto error;
+
+	/* initialization */
+	process_data_bank_init(child_bank);
+
+	/* update auxiliary data  */
+	child_bank->parent = parent;
+	child_bank->cmdline = (char *)cmdline;
+	child_bank->spawn_fds = fds;
+	child_bank->spawn_fd_cnt = fd_cnt;
+
+	/* the thread is named after the program */
+	len = strcspn(cmdline, " ");
+	strlcpy(name, cmdline, len < sizeof name ? len + 1 : sizeof name);
+
+	tid_t child_tid = thread_create (name, PRI_DEFAULT, __do_spawn, child_bank);
+	if(child_tid == TID_ERROR)
+		goto error;
+
+	/* wait until the child has loaded its program, or failed to */
+	sema_down(&child_bank->sema_fork);
+	if(!child_bank->fork_succ){
+		sema_down(&child_bank->sema_wait);
+		goto error;
+	}
+
+	list_push_back(&parent->child_list, &child_bank->elem);
+	return child_tid;
+
+	error:
+		if(child_bank) palloc_free_page(child_bank);
+		return TID_ERROR;
+}
+
+/* A thread function that builds a process from scratch for
+ * process_spawn(). */
+static void
+__do_spawn (void *aux) {
+	struct thread *current = thread_current ();
+	struct process_data_bank *child_bank = (struct process_data_bank *)aux;
+	struct thread *parent = child_bank->parent;
+
+	/* 1. update rest information of child_bank */
+	child_bank->tid = current->tid;
+
+	/* 2. store memory block data into child thread */
+	current->data_bank = child_bank;
+
+#ifdef EFILESYS
+	/* inherit cwd */
+	if (parent->cwd != NULL)
+		current->cwd = dir_reopen(parent->cwd);
+	else
+		current->cwd = dir_open_root();
+#endif
+#ifdef VM
+	supplemental_page_table_init (&current->spt);
+#endif
+
+	/* The parent is blocked until we report back, so its fd table
+	 * holds still while we copy from it. */
+	if(!fd_table_inherit(&current->fds, &parent->fds,
+				child_bank->spawn_fds, child_bank->spawn_fd_cnt))
+		goto error;
+
+	/* process_exec() reports success once the program is loaded,
+	 * and returns only if it cannot be. */
+	child_bank->spawn_mark = true;
+	process_exec (child_bank->cmdline);
+
+error:
+	child_bank->fork_succ = false;
+	sema_up(&child_bank->sema_fork);
+	thread_exit ();
+}
+
 static void 
 construct_stack(struct intr_frame *if_, int argc, char ** argv)
 {
@@ -455,7 +467,7 @@ process_exec (void *f_name) {
 	struct process_data_bank *cur_bank = thread_current()->data_bank;
 
 	/* parse command line */
-	strlcpy(cmdline, f_name, PGSIZE);
+	strlcpy(cmdline, f_name, sizeof cmdline);
 
 	/* after copying data into cmdline, 
 		we can free cmdline_copy in process_create_initd */
@@ -482,6 +494,7 @@ process_exec (void *f_name) {
 
 	/* We first kill the current context */
 	process_cleanup ();
+	thread_current ()->ring = NULL;
 #ifdef VM
 	supplemental_page_table_init(&thread_current()->spt);
 #endif
@@ -492,6 +505,15 @@ process_exec (void *f_name) {
 	if (!success)
 		return -1;
 
+	/* F_NAME and the spawn actions belong to the spawning parent,
+	 * which may free them as soon as it hears from us. */
+	if(cur_bank->spawn_mark)
+	{
+		cur_bank->spawn_mark = false;
+		cur_bank->fork_succ = true;
+		sema_up(&cur_bank->sema_fork);
+	}
+
 	construct_stack(&_if, argc, argv);
 
 	/* Start switched process. */
@@ -574,54 +596,13 @@ process_exit (void) {
 	 * TODO: We recommend you to implement process resource cleanup here. */
 	
 	/* 1. close all open file */
-	struct list *stdin_list = &curr->stdin_list;
-	struct list *stdout_list = &curr->stdout_list;
-	struct list *fd_list = &curr->fd_list;
-	
-	while(!list_empty(stdin_list))
-	{
-		struct list_elem *e = list_pop_front(stdin_list);
-		struct fd *fd_num = list_entry(e, struct fd, elem);
-		palloc_free_page(fd_num);
-	}
-
-	while(!list_empty(stdout_list))
-	{
-		struct list_elem *e = list_pop_front(stdout_list);
-		struct fd *fd_num = list_entry(e, struct fd, elem);
-		palloc_free_page(fd_num);
-	}
-
-	while(!list_empty(fd_list))
-	{
-		struct list_elem *e = list_pop_front(fd_list);
-		struct fd_t *fd_t = list_entry(e, struct fd_t, elem);
-		while(!list_empty(&fd_t->dup2_list))
-		{
-			struct list_elem *e1 = list_pop_front(&fd_t->dup2_list);
-			struct fd *fd_num = list_entry(e1, struct fd, elem);
-			palloc_free_page(fd_num);
-		}
-		file_close(fd_t->file);
-		palloc_free_page(fd_t);
-	}
+	fd_table_destroy(&curr->fds);
 
 #ifdef EFILESYS
 	/* close cwd */
 	if(curr->cwd)	dir_close(curr->cwd);
-
-	struct list *dir_list = &curr->dir_list;
-	/* close all dir_desc object */
-	while(!list_empty(dir_list))
-	{
-		struct list_elem *e = list_pop_front(dir_list);
-		struct dir_desc *desc = list_entry(e, struct dir_desc, elem);
-		dir_close(desc->dir);
-		palloc_free_page(desc);
-	}
-	
 #endif
-	
+
 	/* 2. release process_data_bank memory of child_list */
 	
 	/* parent process doesn't wait child process and exit,
@@ -693,8 +674,12 @@ process_cleanup (void) {
  * This function is called on every context switch. */
 void
 process_activate (struct thread *next) {
-	/* Activate thread's page tables. */
-	pml4_activate (next->pml4);
+	/* Activate thread's page tables, keeping its TLB entries
+	 * from the last time it ran if it still holds a PCID. */
+	if (next->pml4 != NULL)
+		pml4_activate_pcid (next->pml4, &next->pcid);
+	else
+		pml4_activate (NULL);
 
 	/* Set thread's kernel stack for use in processing interrupts. */
 	tss_update (next);
@@ -759,33 +744,17 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
- * Stores the executable's entry point into *RIP
- * and its initial stack pointer into *RSP.
- * Returns true if successful, false otherwise. */
-static bool
-load (const char *file_name, struct intr_frame *if_) {
-	struct thread *t = thread_current ();
+/* Reads the headers of the executable FILE, named FILE_NAME, and
+ * checks them.  Returns the resulting image with one reference for
+ * the caller, or a null pointer if FILE is not a valid executable
+ * or memory is exhausted. */
+static struct exec_image *
+read_image (struct file *file, const char *file_name) {
 	struct ELF ehdr;
-	struct file *file = NULL;
-	off_t file_ofs;
-	bool success = false;
-	int i, type;
-
-	/* Allocate and activate page directory. */
-	t->pml4 = pml4_create ();
-	if (t->pml4 == NULL)
-		goto done;
-	process_activate (thread_current ());
-	
-	/* Open executable file. */
-	lock_acquire(&filesys_lock);
-	file = (struct file *)filesys_open (file_name, &type);
-	
-	if (file == NULL) {
-		printf ("load: %s: open failed\n", file_name);
-		goto done;
-	}
+	struct Phdr *phdrs = NULL;
+	struct exec_image *img = NULL;
+	off_t phdrs_size;
+	int i, seg_cnt = 0;
 
 	/* Read and verify executable header. */
 	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -799,19 +768,20 @@ load (const char *file_name, struct intr_frame *if_) {
 		goto done;
 	}
 
-	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
-	for (i = 0; i < ehdr.e_phnum; i++) {
-		struct Phdr phdr;
-
-		if (file_ofs < 0 || file_ofs > file_length (file))
-			goto done;
-		file_seek (file, file_ofs);
+	/* Read program headers, all in one go. */
+	if (ehdr.e_phoff > (uint64_t) file_length (file))
+		goto done;
+	phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+	phdrs = malloc (phdrs_size);
+	if (phdrs == NULL && phdrs_size > 0)
+		goto done;
+	file_seek (file, ehdr.e_phoff);
+	if (file_read (file, phdrs, phdrs_size) != phdrs_size)
+		goto done;
 
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
-		switch (phdr.p_type) {
+	/* Check the program headers and count the loadable segments. */
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		switch (phdrs[i].p_type) {
 			case PT_NULL:
 			case PT_NOTE:
 			case PT_PHDR:
@@ -824,40 +794,106 @@ load (const char *file_name, struct intr_frame *if_) {
 			case PT_SHLIB:
 				goto done;
 			case PT_LOAD:
-				if (validate_segment (&phdr, file)) {
-					bool writable = (phdr.p_flags & PF_W) != 0;
-					uint64_t file_page = phdr.p_offset & ~PGMASK;
-					uint64_t mem_page = phdr.p_vaddr & ~PGMASK;
-					uint64_t page_offset = phdr.p_vaddr & PGMASK;
-					uint32_t read_bytes, zero_bytes;
-					if (phdr.p_filesz > 0) {
-						/* Normal segment.
-						 * Read initial part from disk and zero the rest. */
-						read_bytes = page_offset + phdr.p_filesz;
-						zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-								- read_bytes);
-					} else {
-						/* Entirely zero.
-						 * Don't read anything from disk. */
-						read_bytes = 0;
-						zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-					}
-					if (!load_segment (file, file_page, (void *) mem_page,
-								read_bytes, zero_bytes, writable))
-						goto done;
-				}
-				else
+				if (!validate_segment (&phdrs[i], file))
 					goto done;
+				seg_cnt++;
 				break;
 		}
 	}
+
+	img = exec_image_create (inode_get_inumber (file_get_inode (file)),
+			seg_cnt);
+	if (img == NULL)
+		goto done;
+	img->entry = ehdr.e_entry;
+
+	/* Lay out the loadable segments. */
+	seg_cnt = 0;
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		struct Phdr *phdr = &phdrs[i];
+		struct exec_segment *seg;
+		uint64_t page_offset;
+
+		if (phdr->p_type != PT_LOAD)
+			continue;
+		seg = &img->segs[seg_cnt++];
+		page_offset = phdr->p_vaddr & PGMASK;
+		seg->writable = (phdr->p_flags & PF_W) != 0;
+		seg->file_page = phdr->p_offset & ~PGMASK;
+		seg->mem_page = phdr->p_vaddr & ~PGMASK;
+		if (phdr->p_filesz > 0) {
+			/* Normal segment.
+			 * Read initial part from disk and zero the rest. */
+			seg->read_bytes = page_offset + phdr->p_filesz;
+			seg->zero_bytes = (ROUND_UP (page_offset + phdr->p_memsz, PGSIZE)
+					- seg->read_bytes);
+		} else {
+			/* Entirely zero.
+			 * Don't read anything from disk. */
+			seg->read_bytes = 0;
+			seg->zero_bytes = ROUND_UP (page_offset + phdr->p_memsz, PGSIZE);
+		}
+	}
+
+done:
+	free (phdrs);
+	return img;
+}
+
+/* Loads an ELF executable from FILE_NAME into the current thread.
+ * Stores the executable's entry point into *RIP
+ * and its initial stack pointer into *RSP.
+ * Returns true if successful, false otherwise.
+ *
+ * The checked headers of recently run executables are kept in the
+ * executable image cache, so running one of them again reads
+ * nothing but the pages it touches. */
+static bool
+load (const char *file_name, struct intr_frame *if_) {
+	struct thread *t = thread_current ();
+	struct exec_image *img = NULL;
+	struct file *file = NULL;
+	uint64_t seq;
+	bool success = false;
+	int i, type;
+
+	/* Allocate and activate page directory. */
+	t->pml4 = pml4_create ();
+	if (t->pml4 == NULL)
+		goto done;
+	process_activate (thread_current ());
+	
+	/* Open executable file. */
+	file = (struct file *)filesys_open (file_name, &type);
+	
+	if (file == NULL) {
+		printf ("load: %s: open failed\n", file_name);
+		goto done;
+	}
+
+	/* Find the executable's image, reading it on a miss. */
+	img = exec_cache_lookup (file_get_inode (file), &seq);
+	if (img == NULL) {
+		img = read_image (file, file_name);
+		if (img == NULL)
+			goto done;
+		exec_cache_insert (img, file_get_inode (file), seq);
+	}
+
+	for (i = 0; i < img->seg_cnt; i++) {
+		struct exec_segment *seg = &img->segs[i];
+
+		if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+					seg->read_bytes, seg->zero_bytes, seg->writable))
+			goto done;
+	}
 	
 	/* Set up stack. */
 	if (!setup_stack (if_))
 		goto done;
 
 	/* Start address. */
-	if_->rip = ehdr.e_entry;
+	if_->rip = img->entry;
 
 	/* Deny Write On Excutables */
 	file_deny_write(file);
@@ -869,7 +905,8 @@ load (const char *file_name, struct intr_frame *if_) {
 
 done:
 	/* We arrive here whether the load is successful or not. */
-	lock_release(&filesys_lock);
+	if (img != NULL)
+		exec_image_put (img);
 	return success;
 }
 
@@ -1023,29 +1060,27 @@ install_page (void *upage, void *kpage, bool writable) {
 
 static bool
 lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-	struct loading_datas *datas = (struct loading_datas *)aux;
-	struct file *file = datas->file;
-	size_t read_bytes = datas->read_bytes;
-	size_t zero_bytes = datas->zero_bytes;
-	off_t ofs = datas->ofs;
+	struct segment *seg = aux;
+	size_t seg_ofs = (uint8_t *) page->va - (uint8_t *) seg->upage;
+	size_t read_bytes = 0;
 	void *pa = page->frame->kva;
 	bool success = false;
 
-	if(read_bytes > 0){
-		if(file_read_at(file, pa, read_bytes, ofs) != read_bytes)
+	/* Read this page's share of the segment and zero the rest. */
+	if (seg->read_bytes > seg_ofs) {
+		read_bytes = seg->read_bytes - seg_ofs;
+		if (read_bytes > PGSIZE)
+			read_bytes = PGSIZE;
+		if (file_read_at (seg->file, pa, read_bytes, seg->ofs + seg_ofs)
+				!= (off_t) read_bytes)
 			goto done;
 	}
-
-	memset(pa + read_bytes, 0, zero_bytes);
+	memset (pa + read_bytes, 0, PGSIZE - read_bytes);
 	success = true;
 
-	done:
-		file_close(file);
-		free(datas);
-		return success;
+done:
+	segment_put (seg);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -1060,46 +1095,39 @@ lazy_load_segment (struct page *page, void *aux) {
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * The pages are loaded lazily.  They share one struct segment,
+ * which holds the segment's own handle on FILE, and each works out
+ * its part of the segment from its address when it is loaded.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes, bool writable) {
+	struct segment *seg;
+	size_t page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+	bool success = true;
+
 	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	off_t start_ofs = ofs;
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
+	seg = segment_create (file, ofs, upage, read_bytes);
+	if (seg == NULL)
+		return false;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct loading_datas *aux = malloc(sizeof(struct loading_datas));
-		aux->file = file_duplicate(file);
-		aux->ofs = start_ofs;
-		aux->read_bytes = page_read_bytes;
-		aux->zero_bytes = page_zero_bytes;
-
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-		{
-			file_close(aux->file);
-			free(aux);
-			return false;
+	for (size_t i = 0; i < page_cnt; i++) {
+		if (!vm_alloc_page_with_initializer (VM_ANON | VM_SEGMENT,
+					upage + i * PGSIZE, writable, lazy_load_segment, seg)) {
+			success = false;
+			break;
 		}
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		start_ofs += PGSIZE;
+		seg->refcnt++;
 	}
 
-	return true;
+	/* Drop our own reference; the pages hold theirs. */
+	segment_put (seg);
+	return success;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
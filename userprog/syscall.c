@@ -1,5 +1,7 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -10,11 +12,18 @@
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
 #include "threads/init.h"
+#include "userprog/execcache.h"
+#include "userprog/pipe.h"
 #include "userprog/process.h"
+#include "userprog/usercopy.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/memtrack.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "vm/vm.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
@@ -22,9 +31,18 @@
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 
-static void check_user_memory(void *uaddr);
-static void check_addr_writable(void *uaddr);
-static bool check_fd(int fd);
+static bool user_buffer_ok(const void *buffer, size_t length, bool write);
+static void check_user_buffer(const void *buffer, size_t length, bool write);
+static void check_user_string(const char *ustr);
+static char *copy_in_string(const char *ustr);
+static int file_transfer(struct file *file, void *buffer, size_t length,
+		off_t offset, bool to_file);
+static bool pin_iovec(const struct iovec *iov, int iovcnt, bool write);
+static void unpin_iovec(const struct iovec *iov, int iovcnt);
+
+/* Most bytes of a user buffer pinned at once, so that one large
+ * transfer cannot pin down every frame. */
+#define PIN_CHUNK (64 * PGSIZE)
 
 /* System call.
  *
@@ -39,14 +57,8 @@ static bool check_fd(int fd);
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target */
 #define MSR_SYSCALL_MASK 0xc0000084 /* Mask for the eflags */
 
-#define STDIN_FILENO 0
-#define STDOUT_FILENO 1
-#define STDERR_FILENO 2
-
 void
 syscall_init (void) {
-	
-	lock_init(&filesys_lock);
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -56,6 +68,10 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
+
+	fdtable_init();
+	exec_cache_init();
+	pipe_init();
 }
 
 /* The main system call interface */
@@ -74,6 +90,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	uint64_t arg4 = f->R.r10;
 	uint64_t arg5 = f->R.r8;
 	uint64_t arg6 = f->R.r9;
+
+	thread_current()->rusage.syscalls++;
+	trace_record (TRACE_SYSCALL, thread_current()->tid, f->R.rax, 0);
 	
 	switch (f->R.rax)
 	{
@@ -168,6 +187,54 @@ syscall_handler (struct intr_frame *f UNUSED) {
 			f->R.rax = sys_dup2((int)arg1, (int)arg2);
 			break;
 
+		case SYS_TRACE_DUMP:
+			trace_dump();
+			break;
+
+		case SYS_GETRUSAGE:
+			f->R.rax = sys_getrusage((struct rusage *)arg1);
+			break;
+
+		case SYS_MEMSTAT:
+			memtrack_dump();
+			break;
+
+		case SYS_READV:
+			f->R.rax = sys_readv((int)arg1, (const struct iovec *)arg2, (int)arg3);
+			break;
+
+		case SYS_WRITEV:
+			f->R.rax = sys_writev((int)arg1, (const struct iovec *)arg2, (int)arg3);
+			break;
+
+		case SYS_PREAD:
+			f->R.rax = sys_pread((int)arg1, (void *)arg2, (unsigned)arg3, (off_t)arg4);
+			break;
+
+		case SYS_PWRITE:
+			f->R.rax = sys_pwrite((int)arg1, (const void *)arg2, (unsigned)arg3, (off_t)arg4);
+			break;
+
+		case SYS_RING_SETUP:
+			f->R.rax = sys_ring_setup((struct ring *)arg1, (unsigned)arg2);
+			break;
+
+		case SYS_RING_ENTER:
+			f->R.rax = sys_ring_enter((unsigned)arg1);
+			break;
+
+		case SYS_SPAWN:
+			f->R.rax = sys_spawn((const char *)arg1, (const struct spawn_fd *)arg2, (int)arg3);
+			break;
+
+		case SYS_PIPE:
+			f->R.rax = sys_pipe((int *)arg1);
+			break;
+
+		case SYS_MMAP_SHARED:
+			f->R.rax = (uint64_t)sys_mmap_shared((void *)arg1, (size_t)arg2, (int)arg3);
+			break;
+
 		default:
 			thread_exit();
 			break;
@@ -204,13 +271,13 @@ void sys_exit (int status)
 /* Clone current process. */
 tid_t sys_fork (const char *thread_name, struct intr_frame *f)
 {
-	check_user_memory(thread_name);
+	check_user_string(thread_name);
 	return process_fork(thread_name, f);
 }
 
 /* Switch current process. */
 int sys_exec (const char *cmdline){
-	check_user_memory(cmdline);
+	check_user_string(cmdline);
 
 	/* lock synchronization exist in process_exec */
 	tid_t tid = process_exec(cmdline);
@@ -226,116 +293,138 @@ int sys_wait (tid_t child_id){
 	return process_wait(child_id);
 }
 
+/* Start a new process running CMDLINE, giving it the fds that the
+ * FD_CNT actions in FDS describe. */
+tid_t sys_spawn (const char *cmdline, const struct spawn_fd *fds, int fd_cnt){
+	struct spawn_fd *kfds = NULL;
+	char *kcmdline;
+	tid_t tid;
+
+	if(fd_cnt < 0 || fd_cnt > SPAWN_FD_MAX)
+		return TID_ERROR;
+
+	kcmdline = copy_in_string(cmdline);
+	if(kcmdline == NULL)
+		return TID_ERROR;
+
+	if(fd_cnt > 0){
+		kfds = malloc(fd_cnt * sizeof *kfds);
+		if(kfds == NULL){
+			palloc_free_page(kcmdline);
+			return TID_ERROR;
+		}
+		if(!copy_from_user(kfds, fds, fd_cnt * sizeof *kfds)){
+			free(kfds);
+			palloc_free_page(kcmdline);
+			sys_exit(-1);
+		}
+	}
+
+	tid = process_spawn(kcmdline, kfds, fd_cnt);
+	free(kfds);
+	palloc_free_page(kcmdline);
+	return tid;
+}
+
 /* --------------- file system syscall --------------------- */
 
 /* Create a file. */
 bool sys_create (const char *file, unsigned initial_size)
 {
-	check_user_memory(file);
+	char *path = copy_in_string(file);
 	bool success;
 
-	lock_acquire(&filesys_lock);
-	success = filesys_create(file, initial_size, _FILE);
-	lock_release(&filesys_lock);
+	if(path == NULL)
+		return false;
+	success = filesys_create(path, initial_size, _FILE);
+	palloc_free_page(path);
 
 	return success;
 }
 /* Delete a file. */
 bool sys_remove (const char *file)
 {
-	check_user_memory(file);
-
+	char *path = copy_in_string(file);
 	bool success;
 
-	lock_acquire(&filesys_lock);
-	success = filesys_remove(file);
-	lock_release(&filesys_lock);
+	if(path == NULL)
+		return false;
+	success = filesys_remove(path);
+	palloc_free_page(path);
 
 	return success;
 }
 /* Open a file. */
 int sys_open (const char *file)
 {
-	check_user_memory(file);
+	char *path = copy_in_string(file);
 	void *open_file;
 	int fd;
 	int type;
 
-	lock_acquire(&filesys_lock);
-	open_file = filesys_open(file, &type);
+	if(path == NULL)
+		return -1;
+	open_file = filesys_open(path, &type);
+	palloc_free_page(path);
 	if(open_file == NULL){
-		lock_release(&filesys_lock);
 		return -1;
 	}
 
-	if(type == _FILE)
-		fd = insert_file2list((struct file *)open_file, thread_current());
-
-	else if(type == _DIRECTORY)
-		fd = insert_dir2list((struct dir *)open_file, thread_current());
+	if(type == _FILE){
+		fd = fd_open(&thread_current()->fds, OPEN_FILE, open_file);
+		if(fd < 0)
+			file_close(open_file);
+	}
+	else{
+		fd = fd_open(&thread_current()->fds, OPEN_DIR, open_file);
+		if(fd < 0)
+			dir_close(open_file);
+	}
 
-	lock_release(&filesys_lock);
 	return fd;
 }
 
 /* Obtain a file's size. */
 int sys_filesize (int fd){
 
-	struct thread *t = thread_current();
-	struct fd_t *fd_t;
-	int length;
-
-	if(!check_fd(fd)) return -1;
-
-	lock_acquire(&filesys_lock);
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	if(fd_t == NULL){
-		lock_release(&filesys_lock);
+	struct file *file = fd_get_file(&thread_current()->fds, fd);
+	if(file == NULL)
 		return -1;
-	}
 
-	length = file_length(fd_t->file);
-	lock_release(&filesys_lock);
-	return length;
+	return file_length(file);
 }
 
 /* Read from a file. */
 int sys_read (int fd, void *buffer, unsigned length){
 	
-	struct fd_t *fd_t;
+	struct open_file *of;
 	struct thread *t = thread_current();
 	char *ptr = (char *)buffer;
 	int cnt;
 
-	check_user_memory(ptr);
-	check_user_memory(ptr + length - 1);
-
-#ifdef VM
-	check_addr_writable(ptr);
-	check_addr_writable(ptr + length - 1);
-#endif
-
-	if(!check_fd(fd)) return -1;
-
-	lock_acquire(&filesys_lock);
-
-	struct list_elem *e;
-	struct fd *fd_num;
+	check_user_buffer(buffer, length, true);
 
-	if(fd_num = search_fd_single_list(fd, &t->stdin_list))
+	of = fd_get(&t->fds, fd);
+	if(of != NULL && of->type == OPEN_STDIN)
 		goto stdin_read;
 
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	if(fd_t == NULL){
+	if(of != NULL && of->type == OPEN_PIPE_READ){
+		cnt = pipe_read(of->pipe, buffer, length);
+		goto done;
+	}
+
+	if(of == NULL || of->type != OPEN_FILE){
 		cnt = -1;
 		goto done;
 	}
 	
 	/* read file data and write at buffer */
-	cnt = file_read(fd_t->file, buffer, length);
+	cnt = file_transfer(of->file, buffer, length, file_tell(of->file), false);
+	file_seek(of->file, file_tell(of->file) + cnt);
 
 	done:
-		lock_release(&filesys_lock);
+		if(cnt > 0)
+			t->rusage.read_bytes += cnt;
 		return cnt;
 
 	stdin_read:
@@ -349,8 +438,8 @@ int sys_read (int fd, void *buffer, unsigned length){
 				break;
 			}
 		}
-		check_user_memory(ptr + length);
-		*(ptr + cnt) = NULL;
+		if(!copy_to_user(ptr + cnt, "", 1))
+			sys_exit(-1);
 		goto done;
 
 }
@@ -358,34 +447,34 @@ int sys_read (int fd, void *buffer, unsigned length){
 /* Write to a file. */
 int sys_write (int fd, const void *buffer, unsigned length){
 	
-	struct fd_t *fd_t;
+	struct open_file *of;
 	struct thread *t = thread_current();
 	int cnt;
 
-	check_user_memory(buffer);
-	check_user_memory(buffer + length - 1);
-
-	if(!check_fd(fd)) return -1;
-
-	lock_acquire(&filesys_lock);
+	check_user_buffer(buffer, length, false);
 
-	struct list_elem *e;
-	struct fd *fd_num;
-
-	if(fd_num = search_fd_single_list(fd, &t->stdout_list))
+	of = fd_get(&t->fds, fd);
+	if(of != NULL && of->type == OPEN_STDOUT)
 		goto stdout_write;
 
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	if(fd_t == NULL){
+	if(of != NULL && of->type == OPEN_PIPE_WRITE){
+		cnt = pipe_write(of->pipe, buffer, length);
+		goto done;
+	}
+
+	if(of == NULL || of->type != OPEN_FILE){
 		cnt = -1;
 		goto done;
 	}
 
 	/* write data in buffer to file */
-	cnt = file_write(fd_t->file, buffer, length);
+	cnt = file_transfer(of->file, (void *)buffer, length,
+			file_tell(of->file), true);
+	file_seek(of->file, file_tell(of->file) + cnt);
 	
 	done:
-		lock_release(&filesys_lock);
+		if(cnt > 0)
+			t->rusage.written_bytes += cnt;
 		return cnt;
 
 	stdout_write:
@@ -398,116 +487,48 @@ int sys_write (int fd, const void *buffer, unsigned length){
 /* Change position in a file. */
 void sys_seek (int fd, unsigned position){
 
-	struct thread *t = thread_current();
-	struct fd_t* fd_t;
-	if(!check_fd(fd)) return;
-
-	lock_acquire(&filesys_lock);
-
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	if(fd_t != NULL) file_seek(fd_t->file, position);
-	lock_release(&filesys_lock);
+	struct file *file = fd_get_file(&thread_current()->fds, fd);
+	if(file != NULL) file_seek(file, position);
 
 }
 
 /* Report current position in a file. */
 unsigned sys_tell (int fd){
 
-	struct thread *t = thread_current();
-	unsigned position;
-	struct fd_t *fd_t;
-
-	if(!check_fd(fd)) return -1;
-
-	lock_acquire(&filesys_lock);
-
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	if(fd_t != NULL){
-		position = file_tell(fd_t->file);
-	}
-	else{
-		position = -1;
-	}
+	struct file *file = fd_get_file(&thread_current()->fds, fd);
+	if(file == NULL)
+		return -1;
 
-	lock_release(&filesys_lock);
-	return position;
+	return file_tell(file);
 }
 
 /* Close a file. */
 void sys_close (int fd){
-	
-	struct fd_t *fd_t;
-	struct fd *fd_num;
-	struct list_elem *e;
-	struct thread *t = thread_current();
-
-	if(!check_fd(fd)) return;
-
-	lock_acquire(&filesys_lock);
-
-	if(fd_num = search_fd_single_list(fd, &t->stdin_list)){
-		list_remove(&fd_num->elem);
-		palloc_free_page(fd_num);
-		goto done;
-	}
-
-	if(fd_num = search_fd_single_list(fd, &t->stdout_list)){
-		list_remove(&fd_num->elem);
-		palloc_free_page(fd_num);
-		goto done;
-	}
-
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-	fd_num = search_fd_double_list(fd, &t->fd_list);
-
-	/* search dir_list */
-	if (fd_num != NULL)
-	{
-		list_remove(&fd_num->elem);
-		palloc_free_page(fd_num);
-
-		/* should close file */
-		if (list_empty(&fd_t->dup2_list))
-		{
-			file_close(fd_t->file);
-			list_remove(&fd_t->elem);
-			palloc_free_page(fd_t);
-		}
-		goto done;
-	}
-	else{
-		struct dir_desc *desc = search_dir_list(fd, &t->dir_list);
-		if(desc == NULL)
-			goto done;
-
-		dir_close(desc->dir);
-		list_remove(&desc->elem);
-		palloc_free_page(desc);
-	}
-
-	done:
-		lock_release(&filesys_lock);
-		return;
+	fd_close(&thread_current()->fds, fd);
 }
 
 bool
 sys_chdir (const char *dir) {
-	check_user_memory(dir);
+	char *path = copy_in_string(dir);
+	bool success;
 
-	lock_acquire(&filesys_lock);
-	bool success = filesys_chdir(dir);
-	lock_release(&filesys_lock);
+	if(path == NULL)
+		return false;
+	success = filesys_chdir(path);
+	palloc_free_page(path);
 	return success;
 }
 
 bool
 sys_mkdir (const char *dir) {
-	check_user_memory(dir);
+	char *path = copy_in_string(dir);
+	bool success;
 
-	lock_acquire(&filesys_lock);
+	if(path == NULL)
+		return false;
 	/* file extended support */
-	bool success = filesys_create(dir, 0, _DIRECTORY);
-	lock_release(&filesys_lock);
+	success = filesys_create(path, 0, _DIRECTORY);
+	palloc_free_page(path);
 	return success;
 }
 
@@ -515,411 +536,618 @@ sys_mkdir (const char *dir) {
 bool
 sys_readdir (int fd, char *name) {
 	
-	check_user_memory(name);
-	bool success = false;
+	char kname[NAME_MAX + 1];
 
-	ASSERT(check_fd(fd));
+	check_user_buffer(name, 1, true);
 
-	struct thread *t = thread_current();
+	struct dir *dir = fd_get_dir(&thread_current()->fds, fd);
+	if (dir == NULL)
+		return false;
 
-	lock_acquire(&filesys_lock);
-	struct dir_desc *desc = search_dir_list(fd, &t->dir_list);
-	if (desc == NULL)
-		goto done;
-	success = dir_readdir(desc->dir, name);
-	
-	done:
-		lock_release(&filesys_lock);
-		return success;
+	if (!dir_readdir(dir, kname))
+		return false;
+	if (!copy_to_user(name, kname, strlen(kname) + 1))
+		sys_exit(-1);
+	return true;
 }
 
 bool
 sys_isdir (int fd) {
 	
-	bool is_dir;
-	ASSERT(check_fd(fd));
-
-	lock_acquire(&filesys_lock);
-	
-	struct fd_t *fd_t;
-	struct thread *t = thread_current();
-
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-
-	/* search dir_list */
-	if (fd_t == NULL){
-		struct dir_desc *desc = search_dir_list(fd, &t->dir_list);
-		if(desc == NULL)
-			goto error;
-		is_dir = true;
-	}
-	else
-        is_dir = false;
+	struct open_file *of = fd_get(&thread_current()->fds, fd);
 
 	/* TODO: can not find file or directory, what value return? */
-
-	lock_release(&filesys_lock);
-	return is_dir;
-
-	error:
-		lock_release(&filesys_lock);
+	if (of == NULL)
 		PANIC("error: fd not exists");
+
+	return of->type == OPEN_DIR;
 }
 
 int
 sys_inumber (int fd) {
 	
-	int inumber;
-	if(!check_fd(fd))
-		return -1;
-
-	lock_acquire(&filesys_lock);
-	
-	struct fd_t *fd_t;
 	struct thread *t = thread_current();
 	struct inode *inode = NULL;
+	struct file *file = fd_get_file(&t->fds, fd);
+	struct dir *dir = fd_get_dir(&t->fds, fd);
 
-	fd_t = search_fd_t_double_list(fd, &t->fd_list);
-
-	/* search dir_list */
-	if (fd_t == NULL){
-		struct dir_desc *desc = search_dir_list(fd, &t->dir_list);
-		if(desc == NULL)
-			goto error;
-		inode = dir_get_inode(desc->dir);
-	}
-	else
-		inode = file_get_inode(fd_t->file);
+	if (file != NULL)
+		inode = file_get_inode(file);
+	else if (dir != NULL)
+		inode = dir_get_inode(dir);
 
 	/* can not find file or directory, which has fd */
 	if(inode == NULL)
-		goto error;
+		return -1;
 
-	inumber = inode_get_inumber(inode);
+	return inode_get_inumber(inode);
+}
 
-	lock_release(&filesys_lock);
-	return inumber;
+/* ----------------- Extra Credit -------------------------- */
+/* Duplicate the file descriptor */
+int sys_dup2(int oldfd, int newfd){
+	return fd_dup2(&thread_current()->fds, oldfd, newfd);
+}
+/* Projects 2 and later. ----------------------------------- */                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                       
 
-	error:
-		lock_release(&filesys_lock);
-		return -1;
+/* Project 3 */
+void *sys_mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	
+	struct file *file = fd_get_file(&thread_current()->fds, fd);
 
-}
+	/* handle error case */
+	/* file_descriptors which is invalid, or console input and output should not mappable */
+	if(!file)	goto error;
 
-struct fd *search_fd_single_list(int fd, struct list *list){
-	struct list_elem *e;
-	struct fd *fd_num;
+	if(length == 0)
+		goto error;
 
-	if(list_empty(list)) return NULL;
-	for(e = list_begin(list); e != list_end(list); e = list_next(e))
-	{
-		fd_num = list_entry(e, struct fd, elem);
-		if(fd_num->fd == fd)
-			return fd_num;
-	}
-	return NULL;
-}
+	if(pg_ofs(addr) != 0)
+		goto error;
 
-struct fd *search_fd_double_list(int fd, struct list *list){
-	struct list_elem *e;
-	struct fd_t *fd_t;
-	struct fd *fd_num;
+	if(pg_ofs(offset) != 0)	/* offset should be aligned to PGSIZE, testcase: mmap-bad-off */
+		goto error;
 
-	if(list_empty(list))
-		return NULL;
+	if(addr == NULL)
+		goto error;
+
+	if(!is_user_range(addr, length))
+		goto error;
 	
-	for(e = list_begin(list); e != list_end(list); e = list_next(e))
-	{
-		fd_t = list_entry(e, struct fd_t, elem);
-		fd_num = search_fd_single_list(fd, &fd_t->dup2_list);
-		if(fd_num)	return fd_num;
-	}
-	return NULL;
+	/* include return NULL when some page in the middle is allocated already */
+	return do_mmap(addr, length, writable, file, offset);
+
+	error:
+		return NULL;
 }
 
-struct fd_t *search_fd_t_double_list(int fd, struct list *list){
-	struct list_elem *e;
-	struct fd_t *fd_t;
-	struct fd *fd_num;
+void sys_munmap(void *addr){
+#ifdef VM
+	/* don't need to check address invalidity */
+	struct page *page = spt_find_page(&thread_current()->spt, addr);
+
+	if(page != NULL && page_get_type(page) == VM_SHARED)
+		shm_munmap(addr);
+	else
+		do_munmap(addr);
+#endif
+}
 
-	if(list_empty(list))
-		return NULL;
-	
-	for(e = list_begin(list); e != list_end(list); e = list_next(e))
-	{
-		fd_t = list_entry(e, struct fd_t, elem);
-		fd_num = search_fd_single_list(fd, &fd_t->dup2_list);
-		if(fd_num)	return fd_t;
-	}
-	return NULL;
+/* ----------------- Kernel diagnostics -------------------- */
+/* Report the resource usage of the current process. */
+int sys_getrusage(struct rusage *usage){
+	if(!copy_to_user(usage, &thread_current()->rusage, sizeof *usage))
+		sys_exit(-1);
+	return 0;
 }
 
-struct dir_desc *search_dir_list(int fd, struct list *list)
+
+
+/* ----------------- Vectored and positional I/O ----------- */
+
+/* Copies the IOVCNT-segment vector at UIOV into kernel memory,
+ * then checks every segment the copy names as user memory that
+ * must be writable if WRITABLE.  Only the copy is checked and used,
+ * so a process that shares the vector's memory cannot change a
+ * segment once it has been approved.  Stores the total length in
+ * *TOTAL and returns the copy, which the caller must free, or a
+ * null pointer if IOVCNT is out of range, the total overflows an
+ * int, or memory is exhausted.  Terminates the process on a bad
+ * pointer. */
+static struct iovec *
+copy_in_iovec(const struct iovec *uiov, int iovcnt, bool writable, int *total)
 {
-	struct list_elem *e;
-	struct dir_desc *desc;
+	struct iovec *iov;
+	size_t sum = 0;
 
-	if(list_empty(list))
+	if(iovcnt <= 0 || iovcnt > IOV_MAX)
+		return NULL;
+	iov = malloc(iovcnt * sizeof *iov);
+	if(iov == NULL)
 		return NULL;
+	if(!copy_from_user(iov, uiov, iovcnt * sizeof *iov)){
+		free(iov);
+		sys_exit(-1);
+	}
 
-	for(e = list_begin(list); e != list_end(list); e = list_next(e))
-	{
-		desc = list_entry(e, struct dir_desc, elem);
-		if(desc->fd == fd)
-			return desc;
+	for(int i = 0; i < iovcnt; i++){
+		size_t len = iov[i].iov_len;
+
+		if(len == 0)
+			continue;
+		if(len > INT_MAX - sum){
+			free(iov);
+			return NULL;
+		}
+		sum += len;
+		if(!user_buffer_ok(iov[i].iov_base, len, writable)){
+			free(iov);
+			sys_exit(-1);
+		}
 	}
-	return NULL;
-}
 
-/* insert file to fd_list and increase next_fd */
-int insert_file2list(struct file *file, struct thread *thread){
-	struct thread *t = thread;
-	int fd;
+	*total = sum;
+	return iov;
+}
 
-	struct fd_t *fd_t = (struct fd_t *)palloc_get_page(0);
-	if(fd_t == NULL)
-		goto error;
+/* Read from a file into several buffers. */
+int sys_readv(int fd, const struct iovec *uiov, int iovcnt){
+	struct thread *t = thread_current();
+	struct iovec *iov;
+	struct file *file;
+	struct pipe *pipe;
+	int total, cnt;
 
-	list_init(&fd_t->dup2_list);
+	iov = copy_in_iovec(uiov, iovcnt, true, &total);
+	if(iov == NULL)
+		return -1;
 
-	struct fd *fd_num = (struct fd *)palloc_get_page(0);
-	if(fd_num == NULL)
-		goto error;
-	
-	fd = t->next_fd++;
+	file = fd_get_file(&t->fds, fd);
+	pipe = fd_get_pipe(&t->fds, fd, false);
+	if(pipe != NULL){
+		/* A pipe read returns whatever is there, so fill just the
+		 * first segment rather than wait for more. */
+		int i = 0;
+		while(i < iovcnt && iov[i].iov_len == 0)
+			i++;
+		cnt = i < iovcnt ? pipe_read(pipe, iov[i].iov_base, iov[i].iov_len) : 0;
+	}
+	else if(file == NULL)
+		cnt = -1;
+	else if(total <= PIN_CHUNK && pin_iovec(iov, iovcnt, true)){
+		cnt = file_readv(file, iov, iovcnt);
+		unpin_iovec(iov, iovcnt);
+	}
+	else{
+		/* Too much to pin at once: go a segment at a time. */
+		cnt = 0;
+		for(int i = 0; i < iovcnt; i++){
+			int n = file_transfer(file, iov[i].iov_base, iov[i].iov_len,
+					file_tell(file), false);
+			file_seek(file, file_tell(file) + n);
+			cnt += n;
+			if((size_t)n < iov[i].iov_len)
+				break;
+		}
+	}
+	free(iov);
 
-	fd_num->fd = fd;
-	fd_t->file = file;
+	if(cnt > 0)
+		t->rusage.read_bytes += cnt;
+	return cnt;
+}
 
-	list_push_back(&t->fd_list, &fd_t->elem);
-	list_push_back(&fd_t->dup2_list, &fd_num->elem);
-	return fd;
+/* Write to a file from several buffers. */
+int sys_writev(int fd, const struct iovec *uiov, int iovcnt){
+	struct thread *t = thread_current();
+	struct open_file *of;
+	struct iovec *iov;
+	int total, cnt;
 
-	error:
-		if(fd_t) palloc_free_page(fd_t);
-		if(fd_num) palloc_free_page(fd_num);
+	iov = copy_in_iovec(uiov, iovcnt, false, &total);
+	if(iov == NULL)
 		return -1;
+
+	of = fd_get(&t->fds, fd);
+	if(of != NULL && of->type == OPEN_STDOUT){
+		for(int i = 0; i < iovcnt; i++)
+			putbuf(iov[i].iov_base, iov[i].iov_len);
+		cnt = total;
+	}
+	else if(of != NULL && of->type == OPEN_PIPE_WRITE){
+		cnt = 0;
+		for(int i = 0; i < iovcnt; i++){
+			int n = pipe_write(of->pipe, iov[i].iov_base, iov[i].iov_len);
+			if(n < 0){
+				if(cnt == 0)
+					cnt = -1;
+				break;
+			}
+			cnt += n;
+			if((size_t)n < iov[i].iov_len)
+				break;
+		}
+	}
+	else if(of != NULL && of->type == OPEN_FILE){
+		if(total <= PIN_CHUNK && pin_iovec(iov, iovcnt, false)){
+			cnt = file_writev(of->file, iov, iovcnt);
+			unpin_iovec(iov, iovcnt);
+		}
+		else{
+			/* Too much to pin at once: go a segment at a time. */
+			cnt = 0;
+			for(int i = 0; i < iovcnt; i++){
+				int n = file_transfer(of->file, iov[i].iov_base,
+						iov[i].iov_len, file_tell(of->file), true);
+				file_seek(of->file, file_tell(of->file) + n);
+				cnt += n;
+				if((size_t)n < iov[i].iov_len)
+					break;
+			}
+		}
+	}
+	else
+		cnt = -1;
+	free(iov);
+
+	if(cnt > 0)
+		t->rusage.written_bytes += cnt;
+	return cnt;
 }
 
-/* insert file to fd_list and increase next_fd */
-int insert_dir2list(struct dir *dir, struct thread *curr){
+/* Read from a file at OFFSET without moving its position. */
+int sys_pread(int fd, void *buffer, unsigned length, off_t offset){
+	struct thread *t = thread_current();
+	char *ptr = buffer;
+	struct file *file;
+	int cnt;
+
+	if(length == 0)
+		return 0;
+	check_user_buffer(ptr, length, true);
 
-	struct dir_desc *dir_desc= (struct dir_desc *)palloc_get_page(0);
-	if(dir_desc == NULL)
+	file = fd_get_file(&t->fds, fd);
+	/* OFFSET + LENGTH must not overflow an off_t. */
+	if(file == NULL || offset < 0 || length > (unsigned)(INT_MAX - offset))
 		return -1;
 
-	dir_desc->fd = curr->next_fd++;
-	dir_desc->dir = dir;
-	list_push_back(&curr->dir_list, &dir_desc->elem);
-
-	return dir_desc->fd;
+	cnt = file_transfer(file, buffer, length, offset, false);
+	if(cnt > 0)
+		t->rusage.read_bytes += cnt;
+	return cnt;
 }
 
-/* ----------------- Extra Credit -------------------------- */
-/* Duplicate the file descriptor */
-int sys_dup2(int oldfd, int newfd){
+/* Write to a file at OFFSET without moving its position. */
+int sys_pwrite(int fd, const void *buffer, unsigned length, off_t offset){
 	struct thread *t = thread_current();
-	struct fd_t *old_fd_t;
-	struct fd_t *new_fd_t;
-	struct fd_t *fd_t;
-	struct fd *fd_num0;
-	struct list *push_list;
+	const char *ptr = buffer;
+	struct file *file;
+	int cnt;
 
-	bool oldfd_exist = false;
-	bool newfd_exist = false;
+	if(length == 0)
+		return 0;
+	check_user_buffer(ptr, length, false);
 
-	/* check oldfd */
-	if(!check_fd(oldfd)) return -1;
+	file = fd_get_file(&t->fds, fd);
+	/* OFFSET + LENGTH must not overflow an off_t. */
+	if(file == NULL || offset < 0 || length > (unsigned)(INT_MAX - offset))
+		return -1;
 
-	struct list_elem *e;
-	struct fd *fd_num;
+	cnt = file_transfer(file, (void *)buffer, length, offset, true);
+	if(cnt > 0)
+		t->rusage.written_bytes += cnt;
+	return cnt;
+}
 
-	if(fd_num = search_fd_single_list(oldfd, &t->stdin_list)){
-		oldfd_exist = true;
-		push_list = &t->stdin_list;
-		goto oldfd_valid;
-	}
 
-	if(fd_num = search_fd_single_list(oldfd, &t->stdout_list)){
-		oldfd_exist = true;
-		push_list = &t->stdout_list;
-		goto oldfd_valid;
-	}
+/* ----------------- Interprocess communication ---------- */
 
-	if(old_fd_t = search_fd_t_double_list(oldfd, &t->fd_list)){
-		push_list = &old_fd_t->dup2_list;
-		oldfd_exist = true;
-	}
+/* Create a pipe, storing the fds of its read and write ends in
+ * FDS[0] and FDS[1]. */
+int sys_pipe(int *fds){
+	struct thread *t = thread_current();
+	struct pipe *pipe;
+	int kfds[2];
 
-	oldfd_valid:
-		if(!oldfd_exist) return -1;
+	check_user_buffer(fds, sizeof kfds, true);
 
-	/* if oldfd and newfd have same value, then return newfd */
-	if(oldfd == newfd) return newfd;
+	pipe = pipe_create();
+	if(pipe == NULL)
+		return -1;
 
-	/* if newfd is opened, then close it */
-	if (fd_num = search_fd_single_list(newfd, &t->stdin_list)){
-		newfd_exist = true;
-		goto newfd_valid;
+	kfds[0] = fd_open(&t->fds, OPEN_PIPE_READ, pipe);
+	if(kfds[0] < 0){
+		pipe_close_end(pipe, false);
+		pipe_close_end(pipe, true);
+		return -1;
 	}
-
-	if (fd_num = search_fd_single_list(newfd, &t->stdout_list)){
-		newfd_exist = true;
-		goto newfd_valid;
+	kfds[1] = fd_open(&t->fds, OPEN_PIPE_WRITE, pipe);
+	if(kfds[1] < 0){
+		fd_close(&t->fds, kfds[0]);
+		pipe_close_end(pipe, true);
+		return -1;
 	}
 
-	if(new_fd_t = search_fd_t_double_list(oldfd, &t->fd_list))
-		newfd_exist = true;
-		
-	newfd_valid:
-		if(newfd_exist)
-			sys_close(newfd);
+	if(!copy_to_user(fds, kfds, sizeof kfds)){
+		fd_close(&t->fds, kfds[0]);
+		fd_close(&t->fds, kfds[1]);
+		sys_exit(-1);
+	}
+	return 0;
+}
 
-	/* duplicate it */
-	fd_num0 = palloc_get_page(0);
-	if(fd_num0 == NULL) return -1;
-	
-	fd_num0->fd = newfd;
-	list_push_back(push_list, &fd_num0->elem);
 
-	/* if newfd is bigger than t->next_fd, then change it to newfd */
-	if(newfd >= t->next_fd) t->next_fd = newfd + 1;
-	return newfd;
-}
-/* Projects 2 and later. ----------------------------------- */                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                       
+/* ----------------- Shared memory ----------------------- */
 
-/* Project 3 */
-void *sys_mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+/* Map a new zeroed region of LENGTH bytes at ADDR that stays shared
+ * with children forked afterward.  munmap() unmaps it. */
+void *sys_mmap_shared(void *addr, size_t length, int writable)
 {
-	
-	struct thread *t = thread_current();
-	struct fd_t *fd_t = search_fd_t_double_list(fd, &t->fd_list);
+	if(addr == NULL || pg_ofs(addr) != 0 || length == 0)
+		return NULL;
+	if(!is_user_range(addr, length))
+		return NULL;
 
-	/* handle error case */
-	/* file_descriptors which is invalid, or console input and output should not mappable */
-	if(!fd_t)	goto error;
-	struct file *file = fd_t->file;
+#ifdef VM
+	return shm_mmap(addr, length, writable);
+#else
+	return NULL;
+#endif
+}
 
-	if(length == 0)
-		goto error;
 
-	if(pg_ofs(addr) != 0)
-		goto error;
+/* ----------------- Zero-copy file transfer ------------- */
 
-	if(pg_ofs(offset) != 0)	/* offset should be aligned to PGSIZE, testcase: mmap-bad-off */
-		goto error;
+/* Pins the user BUFFER of LENGTH bytes, which check_user_buffer()
+ * has approved, in memory, so that the kernel may transfer data to
+ * it, if WRITE, or from it without faulting.  Without VM, user
+ * pages never move, so there is nothing to do. */
+static bool pin_buffer(const void *buffer, size_t length, bool write)
+{
+#ifdef VM
+	return vm_pin_buffer(buffer, length, write);
+#else
+	return true;
+#endif
+}
 
-	if(addr == NULL)
-		goto error;
+/* Undoes pin_buffer(). */
+static void unpin_buffer(const void *buffer, size_t length)
+{
+#ifdef VM
+	vm_unpin_buffer(buffer, length);
+#endif
+}
 
-	for(int i = 0; i <= length; i++){
-		if(is_kernel_vaddr(addr + i))
-			goto error;
-	}
-	
-	/* include return NULL when some page in the middle is allocated already */
-	return do_mmap(addr, length, writable, file, offset);
+/* Pins every segment of IOV, which copy_in_iovec() has approved, as
+ * pin_buffer() does.  Returns false, with nothing pinned, on
+ * failure. */
+static bool pin_iovec(const struct iovec *iov, int iovcnt, bool write)
+{
+	for(int i = 0; i < iovcnt; i++)
+		if(!pin_buffer(iov[i].iov_base, iov[i].iov_len, write)){
+			unpin_iovec(iov, i);
+			return false;
+		}
+	return true;
+}
 
-	error:
-		return NULL;
+/* Undoes pin_iovec(). */
+static void unpin_iovec(const struct iovec *iov, int iovcnt)
+{
+	for(int i = 0; i < iovcnt; i++)
+		unpin_buffer(iov[i].iov_base, iov[i].iov_len);
 }
 
-void sys_munmap(void *addr){
-	/* don't need to check address invalidity */
-	lock_acquire(&filesys_lock);
-	do_munmap(addr);
-	lock_release(&filesys_lock);
+/* Transfers LENGTH bytes between FILE, at OFFSET, and the user
+ * BUFFER: into FILE if TO_FILE, out of it otherwise.  BUFFER must
+ * have passed check_user_buffer().  Each chunk of BUFFER is pinned
+ * for the duration, so the file system moves whole sectors
+ * straight between the disk and the process's frames, and never
+ * takes a page fault while it holds an inode lock.  Returns the
+ * number of bytes transferred, which is short at end of file or if
+ * the disk is full. */
+static int file_transfer(struct file *file, void *buffer, size_t length,
+		off_t offset, bool to_file)
+{
+	uint8_t *p = buffer;
+	int total = 0;
+
+	while(length > 0){
+		size_t chunk = length < PIN_CHUNK ? length : PIN_CHUNK;
+		off_t n;
 
+		if(!pin_buffer(p, chunk, !to_file))
+			break;
+		if(to_file)
+			n = file_write_at(file, p, chunk, offset);
+		else
+			n = file_read_at(file, p, chunk, offset);
+		unpin_buffer(p, chunk);
+
+		total += n;
+		p += n;
+		offset += n;
+		length -= n;
+		if((size_t)n < chunk)
+			break;
+	}
+	return total;
 }
 
 
+/* ----------------- Batched system calls ----------------- */
 
-/* check the virtual address validity which provided by user process */
-static void check_user_memory(void *uaddr)
+/* Stores VALUE in the ring index at user address INDEX.
+ * Terminates the process if INDEX is not writable. */
+static void
+put_ring_index(volatile uint32_t *index, uint32_t value)
 {
-	bool is_valid = false;
-	
-	/* invalid pointer */	
-	if(uaddr == NULL)
-		goto done;
+	if(!copy_to_user((void *)index, &value, sizeof value))
+		sys_exit(-1);
+}
 
-	/* a pointer into kernel virtual address space */
-	if(is_kernel_vaddr(uaddr))
-		goto done;
+/* Register RING, holding ENTRIES entries per queue, as the
+ * process's system call ring, replacing any earlier one.  A null
+ * RING unregisters.  Resets all four indexes to 0. */
+int sys_ring_setup(struct ring *ring, unsigned entries){
+	struct thread *t = thread_current();
 
-#ifdef VM
-	struct page *page = spt_find_page(&thread_current()->spt, uaddr);
-	if (is_stack_growth(uaddr, thread_current()->saving_rsp) && !page){
-		is_valid = true;
-		goto done;
+	if(ring == NULL){
+		t->ring = NULL;
+		return 0;
 	}
+	struct ring hdr = { .entries = entries };
 
-	if(!page)
-		goto done;
-
-#else
-	/* a virtual address not mapped to physical address */
-	if(pml4e_walk(thread_current()->pml4, uaddr, false) == NULL)
-		goto done;
-#endif
-
-	is_valid = true;
-	done:
-		/* check whether terminates the user process */
-		if(!is_valid)
-			sys_exit(-1);
+	if(entries == 0 || entries > RING_MAX_ENTRIES
+			|| (entries & (entries - 1)) != 0
+			|| (uintptr_t)ring % sizeof (uint64_t) != 0
+			|| !is_user_range(ring, RING_BYTES(entries)))
+		return -1;
+	if(!copy_to_user(ring, &hdr, sizeof hdr))
+		sys_exit(-1);
 
+	t->ring = ring;
+	t->ring_entries = entries;
+	return 0;
 }
 
-/* check whether virtual address is writable which provided by user process */
-static void check_addr_writable(void *uaddr)
+/* Carries out request SQE and returns its result. */
+static int64_t
+ring_execute(const struct ring_sqe *sqe)
 {
-	bool is_valid = false;
+	void *addr = (void *)sqe->addr;
 
-	if (is_stack_growth(uaddr, thread_current()->saving_rsp)){
-		is_valid = true;
-		goto done;
+	switch(sqe->op)
+	{
+		case RING_NOP:
+			return 0;
+		case RING_READ:
+			return sys_read(sqe->fd, addr, sqe->len);
+		case RING_WRITE:
+			return sys_write(sqe->fd, addr, sqe->len);
+		case RING_PREAD:
+			return sys_pread(sqe->fd, addr, sqe->len, sqe->off);
+		case RING_PWRITE:
+			return sys_pwrite(sqe->fd, addr, sqe->len, sqe->off);
+		case RING_OPEN:
+			return sys_open(addr);
+		case RING_CLOSE:
+			sys_close(sqe->fd);
+			return 0;
+		case RING_SEEK:
+			sys_seek(sqe->fd, sqe->off);
+			return 0;
+		default:
+			return -1;
 	}
-	
-	struct page *page = spt_find_page(&thread_current()->spt, uaddr);
-	if(!page)
-		goto done;
+}
 
-	if(!page->writable)
-		goto done;
-	
-	is_valid = true;
-	done:
-		if(!is_valid)
+/* Runs up to TO_SUBMIT requests from the process's ring, fewer if
+ * the submission queue runs dry or the completion queue fills,
+ * posting a completion for each.  Returns the number run, or -1 if
+ * no ring is registered.  Terminates the process if the ring is no
+ * longer mapped. */
+int sys_ring_enter(unsigned to_submit){
+	struct thread *t = thread_current();
+	struct ring *ring = t->ring;
+	uint32_t entries = t->ring_entries;
+	uint32_t mask = entries - 1;
+	struct ring_sqe *sq;
+	struct ring_cqe *cq;
+	struct ring hdr;
+	unsigned done = 0;
+
+	if(ring == NULL)
+		return -1;
+	if(!copy_from_user(&hdr, ring, sizeof hdr))
+		sys_exit(-1);
+	sq = ring_sq(ring);
+	cq = ring_cq(ring, entries);
+
+	/* The process is inside this call, so the indexes it owns
+	 * cannot move until we return. */
+	while(done < to_submit && hdr.sq_head != hdr.sq_tail
+			&& hdr.cq_tail - hdr.cq_head < entries){
+		struct ring_sqe sqe;
+		struct ring_cqe cqe;
+
+		/* Copy the request before running it, so that it cannot
+		 * change underneath us. */
+		if(!copy_from_user(&sqe, &sq[hdr.sq_head & mask], sizeof sqe))
 			sys_exit(-1);
+		put_ring_index(&ring->sq_head, ++hdr.sq_head);
+
+		cqe.user_data = sqe.user_data;
+		cqe.res = ring_execute(&sqe);
+		if(!copy_to_user(&cq[hdr.cq_tail & mask], &cqe, sizeof cqe))
+			sys_exit(-1);
+		barrier();
+		put_ring_index(&ring->cq_tail, ++hdr.cq_tail);
+		done++;
+	}
+	return done;
 }
 
 
-static bool check_fd(int fd){
-	struct thread *t = thread_current();
-	if((fd < 0) || (fd >= t->next_fd)) return false;
+/* ----------------- User memory -------------------------- */
+
+/* Returns true if the LENGTH bytes at BUFFER are user memory that
+ * the process may read, and write too if WRITE.  Touches one byte
+ * of each page through the user copy routines, so every page is
+ * checked, not just the ends. */
+static bool user_buffer_ok(const void *buffer, size_t length, bool write)
+{
+	const uint8_t *p = buffer;
+	const uint8_t *end = p + length;
+	uint8_t byte;
+
+	if(!is_user_range(buffer, length))
+		return false;
+
+	while(p < end){
+		if(!copy_from_user(&byte, p, 1)
+				|| (write && !copy_to_user((void *)p, &byte, 1)))
+			return false;
+		p = (const uint8_t *)pg_round_down(p) + PGSIZE;
+	}
 	return true;
 }
 
-bool stdio_init(struct thread *t)
+/* Terminates the process unless user_buffer_ok(). */
+static void check_user_buffer(const void *buffer, size_t length, bool write)
 {
-	struct fd *stdin = palloc_get_page(0);
-	if(stdin == NULL)
-		goto error;
+	if(!user_buffer_ok(buffer, length, write))
+		sys_exit(-1);
+}
 
-	stdin->fd = STDIN_FILENO;
-	list_push_back(&t->stdin_list, &stdin->elem);
-		
-	struct fd *stdout = palloc_get_page(0);
-	if(stdout == NULL)
-		goto error;
+/* Terminates the process unless USTR is a string in readable user
+ * memory.  The kernel may then read it in place, since nothing
+ * can unmap it while the process is in a system call. */
+static void check_user_string(const char *ustr)
+{
+	if(strnlen_user(ustr, KERN_BASE) < 0)
+		sys_exit(-1);
+}
 
-	stdout->fd = STDOUT_FILENO;
-	list_push_back(&t->stdout_list, &stdout->elem);
-	return true;
+/* Copies the user string USTR into a new page, which the caller
+ * must free with palloc_free_page().  Returns a null pointer if the
+ * string does not fit in a page or memory is exhausted.
+ * Terminates the process on a bad pointer. */
+static char *copy_in_string(const char *ustr)
+{
+	char *kstr = palloc_get_page(0);
+	long len;
 
-	error:
-		if(stdin) palloc_free_page(stdin);
-		if(stdout) palloc_free_page(stdout);
-		return false;
-}
\ No newline at end of file
+	if(kstr == NULL)
+		return NULL;
+	len = strncpy_from_user(kstr, ustr, PGSIZE);
+	if(len < 0 || len == PGSIZE){
+		palloc_free_page(kstr);
+		if(len < 0)
+			sys_exit(-1);
+		return NULL;
+	}
+	return kstr;
+}
@@ -0,0 +1,82 @@
+#include "userprog/usercopy.h"
+
+/* Copying to and from user memory.
+
+   Rather than looking up every page of a user buffer before
+   touching it, these routines check only that the buffer lies
+   below KERN_BASE and then access it.  Pages that are merely not
+   loaded yet are brought in by the page fault handler as usual.
+   A fault that the handler cannot resolve lands on a fixup in
+   uaccess.S, and the routine returns failure.  A valid buffer
+   thus costs one range check however many pages it spans, and
+   every page of an invalid one is caught. */
+
+size_t __copy_user (void *dst, const void *src, size_t size);
+long __strncpy_user (char *dst, const char *src, size_t size);
+long __strnlen_user (const char *src, size_t size);
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns false if any of USRC is not readable user
+   memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size) {
+	if (!is_user_range (usrc, size))
+		return false;
+	return __copy_user (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns false if any of UDST is not writable user
+   memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size) {
+	if (!is_user_range (udst, size))
+		return false;
+	return __copy_user (udst, src, size) == 0;
+}
+
+/* Returns the number of bytes of the user string at USRC, capped
+   at SIZE, that lie below KERN_BASE, or -1 if USRC itself does
+   not. */
+static long
+user_string_limit (const char *usrc, size_t size) {
+	uintptr_t start = (uintptr_t) usrc;
+
+	if (start >= KERN_BASE)
+		return -1;
+	return size < KERN_BASE - start ? size : KERN_BASE - start;
+}
+
+/* Copies the string at user address USRC, with its null
+   terminator, into DST, which holds SIZE bytes.  Returns the
+   string's length; SIZE if it does not fit, in which case DST is
+   not null-terminated; or -1 if the string is not readable user
+   memory. */
+long
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	long limit = user_string_limit (usrc, size);
+	long len;
+
+	if (limit < 0)
+		return -1;
+	len = __strncpy_user (dst, usrc, limit);
+	if (len == limit && (size_t) limit < size)
+		return -1;
+	return len;
+}
+
+/* Returns the length of the string at user address USRC, SIZE if
+   it is longer than that, or -1 if it is not readable user
+   memory. */
+long
+strnlen_user (const char *usrc, size_t size) {
+	long limit = user_string_limit (usrc, size);
+	long len;
+
+	if (limit < 0)
+		return -1;
+	len = __strnlen_user (usrc, limit);
+	if (len == limit && (size_t) limit < size)
+		return -1;
+	return len;
+}
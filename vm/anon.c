@@ -4,6 +4,7 @@
 #include "devices/disk.h"
 #include <bitmap.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
 
@@ -50,23 +51,45 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	return true;
 }
 
+/* Writes the page at KVA to a free swap slot and returns the
+ * slot. */
+size_t
+swap_write (const void *kva) {
+	size_t slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	if (slot == BITMAP_ERROR)
+		PANIC("swap table is full, no enough memory");
+
+	for (int i = 0; i < SECTORS_PER_PAGE; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_PAGE + i,
+				(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
+	return slot;
+}
+
+/* Reads swap slot SLOT into the page at KVA.  The slot stays
+ * allocated. */
+void
+swap_read (size_t slot, void *kva) {
+	for (int i = 0; i < SECTORS_PER_PAGE; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_PAGE + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Frees swap slot SLOT. */
+void
+swap_free (size_t slot) {
+	bitmap_set (swap_table, slot, false);
+}
+
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
-	disk_sector_t sec_num;
-	int i;
 
 	if (anon_page->swap_index == SWAP_IN_STATE)
 		return false;
 
-	
-	for (i = 0; i < SECTORS_PER_PAGE; i++) {
-		sec_num = (disk_sector_t) (anon_page->swap_index * SECTORS_PER_PAGE) + i;
-		disk_read (swap_disk, sec_num, kva + i * DISK_SECTOR_SIZE);
-	}
-	
-	bitmap_set (swap_table, anon_page->swap_index, false);
+	swap_read (anon_page->swap_index, kva);
+	swap_free (anon_page->swap_index);
 	anon_page->swap_index = SWAP_IN_STATE;
 
 	return true;
@@ -76,19 +99,8 @@ anon_swap_in (struct page *page, void *kva) {
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	disk_sector_t sec_num;
-	size_t swap_index;
-	
-	swap_index = bitmap_scan_and_flip (swap_table, 0, 1, false);
-	if(swap_index == BITMAP_ERROR)
-		PANIC("swap table is full, no enough memory");
-
-	for (int i = 0; i < SECTORS_PER_PAGE; i++) {
-		sec_num = (disk_sector_t) (swap_index * SECTORS_PER_PAGE) + i;
-		disk_write (swap_disk, sec_num, page->frame->kva + i * DISK_SECTOR_SIZE);
-	}
 
-	anon_page->swap_index = swap_index;
+	anon_page->swap_index = swap_write (page->frame->kva);
 	pml4_set_dirty (anon_page->thread->pml4, page->va, false);
 
 	return true;
@@ -103,9 +115,8 @@ anon_destroy (struct page *page) {
 		/* corresponding physical memory will be freed at process_clean_up */
 		/* no need : palloc_free_page(page->frame->kva) */
 		list_remove (&page->frame->elem);
-		free(page->frame);
-	}
-	else{
-		bitmap_set (swap_table, page->anon.swap_index, false);
+		kmem_cache_free(frame_cachep, page->frame);
 	}
+	else if (anon_page->swap_index != SWAP_IN_STATE)
+		swap_free (anon_page->swap_index);
 }
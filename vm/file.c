@@ -1,6 +1,9 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
+#include "threads/mmu.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 #include <string.h>
@@ -55,21 +58,24 @@ file_backed_swap_in (struct page *page, void *kva) {
 	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.
+ * The page may belong to another process than the one evicting it,
+ * so it is written from the frame rather than through its user
+ * address, which would fault under the inode lock. */
 static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
-	struct thread *curr = thread_current();
+	struct frame *frame = page->frame;
 
 	struct file *file = file_page->file;
 	size_t read_bytes = file_page->read_bytes;
 	off_t ofs = file_page->ofs;
 
 	/* write back */
-	if(pml4_is_dirty(curr->pml4, page->va))
+	if(pml4_is_dirty(frame->pml4, page->va))
 	{
-		file_write_at(file, page->va, read_bytes, ofs);
-		pml4_set_dirty(curr->pml4, page->va, false);
+		file_write_at(file, frame->kva, read_bytes, ofs);
+		pml4_set_dirty(frame->pml4, page->va, false);
 	}
 	return true;
 }
@@ -83,9 +89,9 @@ file_backed_destroy (struct page *page) {
 	size_t read_bytes = file_page->read_bytes;
 	off_t ofs = file_page->ofs;
 
-	/* write back */
-	if(pml4_is_dirty(thread_current()->pml4, page->va))
-		file_write_at(file, page->va, read_bytes, ofs);
+	/* write back, from the frame as in file_backed_swap_out() */
+	if(page->frame && pml4_is_dirty(page->frame->pml4, page->va))
+		file_write_at(file, page->frame->kva, read_bytes, ofs);
 
 	file_close(file_page->file);
 
@@ -93,7 +99,7 @@ file_backed_destroy (struct page *page) {
 		/* corresponding physical memory will be freed at process_clean_up */
 		/* no need : palloc_free_page(page->frame->kva) */
 		list_remove(&page->frame->elem);
-		free(page->frame);
+		kmem_cache_free(frame_cachep, page->frame);
 	}
 
 }
@@ -115,7 +121,7 @@ do_mmap (void *addr, size_t length, int writable,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 
 		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct loading_datas *aux = malloc(sizeof(struct loading_datas));
+		struct loading_datas *aux = kmem_cache_alloc(loading_datas_cachep);
 		aux->file = file_reopen(file);
 		aux->ofs = start_ofs;
 		aux->read_bytes = page_read_bytes;
@@ -125,7 +131,7 @@ do_mmap (void *addr, size_t length, int writable,
 					writable, lazy_load_file, aux))
 		{
 			file_close(aux->file);
-			free(aux);
+			kmem_cache_free(loading_datas_cachep, aux);
 
 			/* munmap page from addr to start_addr */
 			struct page *page = spt_find_page(&thread_current()->spt, addr);
@@ -144,6 +150,13 @@ do_mmap (void *addr, size_t length, int writable,
 	return addr;
 }
 
+/* Frees the frame that PTE maps, for do_munmap(). */
+static bool
+free_mapped_frame (uint64_t *pte, void *va UNUSED, void *aux UNUSED) {
+	palloc_free_page(ptov(PTE_ADDR(*pte)));
+	return true;
+}
+
 /* Do the munmap */
 void
 do_munmap (void *addr) {
@@ -159,11 +172,19 @@ do_munmap (void *addr) {
 	void *start_addr = addr;
 	if(page_get_type(page) == VM_FILE && length > 0)
 	{
+		size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+		uint64_t *pml4 = thread_current()->pml4;
+
 		while(start_addr < (addr + length)){
 			page = spt_find_page(&thread_current()->spt, start_addr);
 			spt_remove_page(&thread_current()->spt, page);
 			start_addr += PGSIZE;
 		}
+
+		/* Unmap the loaded pages, which were written back above, in
+		 * one pass over the page tables and one TLB flush. */
+		pml4_for_range(pml4, addr, page_cnt, free_mapped_frame, NULL);
+		pml4_clear_range(pml4, addr, page_cnt);
 	}
 }
 
@@ -189,6 +210,6 @@ lazy_load_file (struct page *page, void *aux) {
 	success = true;
 
 	done:
-		free(datas);
+		kmem_cache_free(loading_datas_cachep, datas);
 		return success;
 }
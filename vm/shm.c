@@ -0,0 +1,291 @@
+/* shm.c: Implementation of shared anonymous memory.
+ *
+ * A shared region is an array of slots, one for each of its pages.
+ * Every process that maps the region has a struct page of its own
+ * for each slot, but while a slot is resident, all of its pages that
+ * have been faulted in map the one frame that holds it.  The frame
+ * appears once in the frame table, on behalf of one of those pages.
+ * Evicting it writes the slot to the swap disk once and unmaps it
+ * from every address space together; the next fault, in whichever
+ * process, reads it back for all of them.
+ *
+ * A region lives as long as any page refers to it.  fork() gives the
+ * child pages of the same slots, so parent and child keep sharing the
+ * region, and nothing about it ever touches the file system.
+ *
+ * Slots and regions are guarded by frame_lock. */
+
+#include "vm/vm.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* SWAP_SLOT of a slot that is not on the swap disk. */
+#define SWAP_NONE ((size_t) -1)
+
+/* A page of a shared region. */
+struct shm_slot {
+	struct shm *shm;            /* Region it belongs to. */
+	struct frame *frame;        /* Frame holding it, or NULL. */
+	size_t swap_slot;           /* Swap slot holding it, or SWAP_NONE. */
+	struct list pages;          /* Pages that map FRAME. */
+};
+
+/* A shared anonymous region. */
+struct shm {
+	int refcnt;                 /* Pages, in any process, of the region. */
+	size_t page_cnt;            /* Number of elements in SLOTS. */
+	struct shm_slot slots[];
+};
+
+static bool shm_swap_in (struct page *page, void *kva);
+static bool shm_swap_out (struct page *page);
+static void shm_destroy (struct page *page);
+
+/* DO NOT MODIFY this struct */
+static const struct page_operations shm_ops = {
+	.swap_in = shm_swap_in,
+	.swap_out = shm_swap_out,
+	.destroy = shm_destroy,
+	.type = VM_SHARED,
+};
+
+/* Initializes PAGE, an uninit page whose aux is its slot, as a
+ * shared page of the current process. */
+bool
+shm_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	struct shm_slot *slot = page->uninit.aux;
+
+	page->operations = &shm_ops;
+	page->shm.slot = slot;
+	page->shm.pml4 = thread_current ()->pml4;
+	return true;
+}
+
+/* Frees FRAME, which no page table maps. */
+static void
+free_frame (struct frame *frame) {
+	list_remove (&frame->elem);
+	palloc_free_page (frame->kva);
+	kmem_cache_free (frame_cachep, frame);
+}
+
+/* Maps PAGE, a page of the current process, to its slot's frame,
+ * first bringing the slot into a frame if it is not resident.
+ * Called in place of the usual claim with frame_lock held. */
+bool
+shm_claim_page (struct page *page) {
+	struct shm_slot *slot;
+	bool fresh = false;
+
+	if (page->operations->type == VM_UNINIT)
+		page->uninit.page_initializer (page, page->uninit.type, NULL);
+	slot = page->shm.slot;
+
+	if (slot->frame == NULL) {
+		struct frame *frame = vm_get_frame ();
+
+		if (frame == NULL)
+			return false;
+		if (slot->swap_slot != SWAP_NONE)
+			swap_read (slot->swap_slot, frame->kva);
+		else
+			memset (frame->kva, 0, PGSIZE);
+		frame->page = page;
+		frame->pml4 = page->shm.pml4;
+		slot->frame = frame;
+		fresh = true;
+	}
+
+	if (!pml4_set_page (page->shm.pml4, page->va, slot->frame->kva,
+				page->writable)) {
+		if (fresh) {
+			/* The swap slot still holds the contents. */
+			free_frame (slot->frame);
+			slot->frame = NULL;
+		}
+		return false;
+	}
+	if (fresh && slot->swap_slot != SWAP_NONE) {
+		swap_free (slot->swap_slot);
+		slot->swap_slot = SWAP_NONE;
+	}
+	page->frame = slot->frame;
+	list_push_back (&slot->pages, &page->shm.elem);
+	return true;
+}
+
+/* Shared pages are brought in by shm_claim_page(). */
+static bool
+shm_swap_in (struct page *page UNUSED, void *kva UNUSED) {
+	NOT_REACHED ();
+}
+
+/* Writes PAGE's slot to the swap disk and unmaps it from every
+ * address space.  The caller reuses the frame. */
+static bool
+shm_swap_out (struct page *page) {
+	struct shm_slot *slot = page->shm.slot;
+
+	slot->swap_slot = swap_write (slot->frame->kva);
+	while (!list_empty (&slot->pages)) {
+		struct page *p = list_entry (list_pop_front (&slot->pages),
+				struct page, shm.elem);
+		pml4_clear_page (p->shm.pml4, p->va);
+		p->frame = NULL;
+	}
+	slot->frame = NULL;
+	return true;
+}
+
+/* Drops a page's reference to SLOT's region, freeing the region
+ * with the last one.  Otherwise keeps SLOT's frame, if any, on
+ * behalf of a page that still maps it, or moves it to swap if none
+ * does. */
+static void
+slot_put (struct shm_slot *slot) {
+	struct shm *shm = slot->shm;
+
+	ASSERT (shm->refcnt > 0);
+	if (--shm->refcnt == 0) {
+		for (size_t i = 0; i < shm->page_cnt; i++) {
+			if (shm->slots[i].frame != NULL)
+				free_frame (shm->slots[i].frame);
+			if (shm->slots[i].swap_slot != SWAP_NONE)
+				swap_free (shm->slots[i].swap_slot);
+		}
+		free (shm);
+		return;
+	}
+
+	if (slot->frame == NULL)
+		return;
+	if (!list_empty (&slot->pages)) {
+		struct page *p = list_entry (list_front (&slot->pages),
+				struct page, shm.elem);
+		slot->frame->page = p;
+		slot->frame->pml4 = p->shm.pml4;
+	} else {
+		slot->swap_slot = swap_write (slot->frame->kva);
+		free_frame (slot->frame);
+		slot->frame = NULL;
+	}
+}
+
+/* Destroys PAGE, with frame_lock held.  The frame is unmapped here
+ * rather than left for pml4_destroy(), which would free it under
+ * the other processes still sharing it. */
+static void
+shm_destroy (struct page *page) {
+	if (page->frame != NULL) {
+		list_remove (&page->shm.elem);
+		pml4_clear_page (page->shm.pml4, page->va);
+		page->frame = NULL;
+	}
+	slot_put (page->shm.slot);
+}
+
+/* Destroys the uninit shared page whose aux is AUX, with frame_lock
+ * held. */
+void
+shm_uninit_destroy (void *aux) {
+	slot_put (aux);
+}
+
+/* Adds an uninit page for SLOT at UPAGE to the current process. */
+static bool
+map_slot (struct shm_slot *slot, void *upage, bool writable) {
+	if (!vm_alloc_page_with_initializer (VM_SHARED, upage, writable,
+				NULL, slot))
+		return false;
+
+	lock_acquire (&frame_lock);
+	slot->shm->refcnt++;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Gives the current process, a child being forked, its own page for
+ * PARENT's slot.  The page maps the slot's frame at once if PARENT
+ * does. */
+bool
+shm_fork_page (struct page *parent) {
+	struct shm_slot *slot;
+
+	if (parent->operations->type == VM_UNINIT)
+		return map_slot (parent->uninit.aux, parent->va, parent->writable);
+
+	slot = parent->shm.slot;
+	if (!map_slot (slot, parent->va, parent->writable))
+		return false;
+	return parent->frame == NULL || vm_claim_page (parent->va);
+}
+
+/* Removes the CNT pages at ADDR from the current process. */
+static void
+unmap_pages (void *addr, size_t cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (size_t i = 0; i < cnt; i++) {
+		struct page *page = spt_find_page (spt, addr + i * PGSIZE);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+}
+
+/* Maps a new shared region of LENGTH bytes, zeroed, at ADDR, which
+ * is page-aligned, in the current process.  Returns ADDR, or a null
+ * pointer if some page in the range is in use or memory is
+ * exhausted. */
+void *
+shm_mmap (void *addr, size_t length, bool writable) {
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	struct shm *shm;
+
+	shm = malloc (sizeof *shm + page_cnt * sizeof *shm->slots);
+	if (shm == NULL)
+		return NULL;
+	shm->refcnt = 0;
+	shm->page_cnt = page_cnt;
+	for (size_t i = 0; i < page_cnt; i++) {
+		struct shm_slot *slot = &shm->slots[i];
+
+		slot->shm = shm;
+		slot->frame = NULL;
+		slot->swap_slot = SWAP_NONE;
+		list_init (&slot->pages);
+	}
+
+	for (size_t i = 0; i < page_cnt; i++)
+		if (!map_slot (&shm->slots[i], addr + i * PGSIZE, writable)) {
+			/* Removing the last page frees SHM. */
+			if (i == 0)
+				free (shm);
+			unmap_pages (addr, i);
+			return NULL;
+		}
+	return addr;
+}
+
+/* Unmaps the shared region mapped at ADDR in the current process.
+ * Does nothing unless ADDR is the first page of such a mapping. */
+void
+shm_munmap (void *addr) {
+	struct page *page = spt_find_page (&thread_current ()->spt, addr);
+	struct shm_slot *slot;
+
+	if (page == NULL || page->va != addr
+			|| page_get_type (page) != VM_SHARED)
+		return;
+	slot = page->operations->type == VM_UNINIT
+		? page->uninit.aux : page->shm.slot;
+	if (slot != &slot->shm->slots[0])
+		return;
+	unmap_pages (addr, slot->shm->page_cnt);
+}
@@ -10,6 +10,7 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include "threads/slab.h"
 
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
@@ -62,8 +63,13 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
+	struct uninit_page *uninit = &page->uninit;
 	/* TODO: Fill this function.
 	 * TODO: If you don't have anything to do, just return. */
-	if(page->uninit.aux) free(page->uninit.aux);
+	if (VM_TYPE (uninit->type) == VM_SHARED)
+		shm_uninit_destroy (uninit->aux);
+	else if (uninit->type & VM_SEGMENT)
+		segment_put (uninit->aux);
+	else
+		kmem_cache_free(loading_datas_cachep, uninit->aux);
 }
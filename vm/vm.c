@@ -1,6 +1,9 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
@@ -8,7 +11,15 @@
 #include "threads/mmu.h"
 
 static struct list frame_list;
-static struct lock frame_lock;
+struct lock frame_lock;
+
+/* Slab caches for VM objects. */
+static struct kmem_cache *page_cachep;
+struct kmem_cache *frame_cachep;
+struct kmem_cache *loading_datas_cachep;
+static struct kmem_cache *segment_cachep;
+
+static bool vm_migrate_frame (void *old_kva, void *new_kva);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -24,6 +35,15 @@ vm_init (void) {
 	/* TODO: Your code goes here. */
 	list_init(&frame_list);
 	lock_init(&frame_lock);
+	lock_set_name(&frame_lock, "frame");
+
+	page_cachep = kmem_cache_create("page", sizeof (struct page), NULL);
+	frame_cachep = kmem_cache_create("frame", sizeof (struct frame), NULL);
+	loading_datas_cachep = kmem_cache_create("loading_datas",
+			sizeof (struct loading_datas), NULL);
+	segment_cachep = kmem_cache_create("segment",
+			sizeof (struct segment), NULL);
+	palloc_set_migrate_func(vm_migrate_frame);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -40,6 +60,43 @@ page_get_type (struct page *page) {
 	}
 }
 
+/* Returns a new segment that reads READ_BYTES bytes of FILE from
+ * offset OFS into the pages starting at UPAGE, with one reference
+ * for the caller, or NULL if memory is exhausted.  The segment
+ * opens FILE anew, so the caller keeps its own handle. */
+struct segment *
+segment_create (struct file *file, off_t ofs, void *upage,
+		size_t read_bytes) {
+	struct segment *seg = kmem_cache_alloc (segment_cachep);
+	if (seg == NULL)
+		return NULL;
+
+	seg->file = NULL;
+	if (read_bytes > 0) {
+		seg->file = file_reopen (file);
+		if (seg->file == NULL) {
+			kmem_cache_free (segment_cachep, seg);
+			return NULL;
+		}
+	}
+	seg->ofs = ofs;
+	seg->upage = upage;
+	seg->read_bytes = read_bytes;
+	seg->refcnt = 1;
+	return seg;
+}
+
+/* Drops a reference to SEG, closing its file with the last one. */
+void
+segment_put (struct segment *seg) {
+	ASSERT (seg->refcnt > 0);
+	if (--seg->refcnt > 0)
+		return;
+
+	file_close (seg->file);
+	kmem_cache_free (segment_cachep, seg);
+}
+
 /* Helpers */
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
@@ -67,7 +124,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 	
 	/* TODO: Create the page */
-	struct page *page = malloc(sizeof(struct page));
+	struct page *page = kmem_cache_alloc(page_cachep);
 	if(page == NULL)
 		goto error;
 	
@@ -85,6 +142,10 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 			case VM_FILE:
 				uninit_new(page, upage, init, type, aux, file_backed_initializer);
 				break;
+
+			case VM_SHARED:
+				uninit_new(page, upage, init, type, aux, shm_initializer);
+				break;
 	
 			default:
 				goto error;
@@ -97,7 +158,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	}
 
 error:
-	if(page) free(page);
+	kmem_cache_free(page_cachep, page);
 	return false;
 }
 
@@ -136,39 +197,48 @@ spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	struct thread *curr = thread_current();
 	 /* TODO: The policy for eviction is up to you. */
 	
 	if(list_empty(&frame_list))
 		PANIC("Impossible, memory leak happens");
 		
+	/* Pinned frames are in use by the kernel: pass over them.  If a
+	 * whole lap finds nothing but pinned frames, there is no victim. */
 	struct list_elem *e = list_begin(&frame_list);
+	bool unpinned = false;
 	while(true){
 		victim = list_entry(e, struct frame, elem);
-		if(!pml4_is_accessed(curr->pml4, victim->page->va))
-			break;
-		pml4_set_accessed(curr->pml4, victim->page->va, false);
+		if(victim->pin_cnt == 0){
+			if(!pml4_is_accessed(victim->pml4, victim->page->va))
+				break;
+			pml4_set_accessed(victim->pml4, victim->page->va, false);
+			unpinned = true;
+		}
 
-		if(e == list_end(&frame_list))
-			list_begin(&frame_list);
-		else
-			list_next(e);
+		e = list_next(e);
+		if(e == list_end(&frame_list)){
+			if(!unpinned)
+				return NULL;
+			e = list_begin(&frame_list);
+		}
 	}
 	
 	return victim;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL if every frame is pinned.*/
 static struct frame *
 vm_evict_frame (void) {
 	struct frame *victim UNUSED = vm_get_victim ();
 	/* TODO: swap out the victim and return the evicted frame. */
+	if(victim == NULL)
+		return NULL;
 	if(!swap_out(victim->page))
 		PANIC("swap memory is full");
 	
 	/* pml4 connection clear */
-	pml4_clear_page(thread_current()->pml4, victim->page->va);
+	pml4_clear_page(victim->pml4, victim->page->va);
 
 	/* page, frame reference clear */
 	victim->page->frame = NULL;
@@ -184,22 +254,26 @@ vm_evict_frame (void) {
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
-static struct frame *
+ * and return it. That is, if the user pool memory is full, this function
+ * evicts the frame to get the available memory space.  Returns NULL if
+ * the pool is full and every frame in it is pinned.  Called with
+ * frame_lock held.*/
+struct frame *
 vm_get_frame (void) {
 	/* TODO: Fill this function. */
-	struct frame *frame = malloc(sizeof(struct frame));
+	struct frame *frame = kmem_cache_alloc(frame_cachep);
 
 	frame->page = NULL;
 	frame->kva = palloc_get_page(PAL_USER);
 	
 	if(frame->kva == NULL){
 		/* swap case */
-		free(frame);
+		kmem_cache_free(frame_cachep, frame);
 		frame = vm_evict_frame();
+		if(frame == NULL)
+			return NULL;
 	}
+	frame->pin_cnt = 0;
 	
 	list_push_back(&frame_list, &frame->elem);
 
@@ -208,6 +282,50 @@ vm_get_frame (void) {
 	return frame;
 }
 
+/* Moves the frame at OLD_KVA to the free user page NEW_KVA, for
+ * user pool compaction: copies the contents, remaps the owner's
+ * page table entry with its accessed and dirty bits, and updates
+ * the frame.  Returns false if no mapped frame lives at OLD_KVA. */
+static bool
+vm_migrate_frame (void *old_kva, void *new_kva) {
+	struct frame *frame = NULL;
+	struct list_elem *e;
+	bool success = false;
+
+	lock_acquire(&frame_lock);
+	for (e = list_begin(&frame_list); e != list_end(&frame_list); e = list_next(e)) {
+		struct frame *f = list_entry(e, struct frame, elem);
+		if (f->kva == old_kva) {
+			frame = f;
+			break;
+		}
+	}
+
+	/* A shared frame is mapped by more page tables than its owner's. */
+	if (frame != NULL && frame->page != NULL && frame->pin_cnt == 0
+			&& page_get_type(frame->page) != VM_SHARED) {
+		struct page *page = frame->page;
+		uint64_t *pml4 = frame->pml4;
+
+		/* The owner must not touch the page between the copy and
+		 * the remap. */
+		enum intr_level old_level = intr_disable();
+		bool dirty = pml4_is_dirty(pml4, page->va);
+		bool accessed = pml4_is_accessed(pml4, page->va);
+
+		memcpy(new_kva, old_kva, PGSIZE);
+		pml4_clear_page(pml4, page->va);
+		success = pml4_set_page(pml4, page->va, new_kva, page->writable);
+		ASSERT(success);
+		pml4_set_dirty(pml4, page->va, dirty);
+		pml4_set_accessed(pml4, page->va, accessed);
+		frame->kva = new_kva;
+		intr_set_level(old_level);
+	}
+	lock_release(&frame_lock);
+	return success;
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
@@ -274,7 +392,7 @@ vm_dealloc_page (struct page *page) {
 	lock_acquire(&frame_lock);
 	destroy (page);
 	lock_release(&frame_lock);
-	free (page);
+	kmem_cache_free (page_cachep, page);
 }
 
 /* Claim the page that allocate on VA. */
@@ -288,6 +406,70 @@ vm_claim_page (void *va UNUSED) {
 	return vm_do_claim_page (page);
 }
 
+/* Pins each page of the SIZE bytes of user memory at UADDR in a
+ * frame, first claiming any that is not resident, so that the
+ * kernel can transfer data to and from the buffer without faulting
+ * until vm_unpin_buffer().  Pins are counted, so a frame pinned
+ * by two calls at once, or by two processes sharing it, stays
+ * pinned until both unpin it.  Returns false, leaving nothing
+ * pinned, if some page is not mapped, or if WRITE and some page is
+ * read-only. */
+bool
+vm_pin_buffer (const void *uaddr, size_t size, bool write) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *start = pg_round_down(uaddr);
+	uint8_t *end = (uint8_t *)uaddr + size;
+	uint8_t *va;
+
+	if (size == 0)
+		return true;
+
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page(spt, va);
+		bool pinned = false;
+
+		if (page == NULL || (write && !page->writable))
+			goto fail;
+
+		/* The frame can be evicted again between claiming it and
+		 * taking frame_lock, so check under the lock. */
+		while (!pinned) {
+			lock_acquire(&frame_lock);
+			if (page->frame != NULL) {
+				page->frame->pin_cnt++;
+				pinned = true;
+			}
+			lock_release(&frame_lock);
+			if (!pinned && !vm_do_claim_page(page))
+				goto fail;
+		}
+	}
+	return true;
+
+fail:
+	vm_unpin_buffer(start, va - start);
+	return false;
+}
+
+/* Unpins the pages of the SIZE bytes of user memory at UADDR, as
+ * pinned by vm_pin_buffer(). */
+void
+vm_unpin_buffer (const void *uaddr, size_t size) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *end = (uint8_t *)uaddr + size;
+	uint8_t *va;
+
+	lock_acquire(&frame_lock);
+	for (va = pg_round_down(uaddr); va < end; va += PGSIZE) {
+		struct page *page = spt_find_page(spt, va);
+		if (page != NULL && page->frame != NULL) {
+			ASSERT (page->frame->pin_cnt > 0);
+			page->frame->pin_cnt--;
+		}
+	}
+	lock_release(&frame_lock);
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
@@ -295,17 +477,36 @@ vm_do_claim_page (struct page *page) {
 	bool swap_succ;
 
 	lock_acquire(&frame_lock);
+	if (page_get_type(page) == VM_SHARED) {
+		/* The slot's frame may already be resident for another
+		 * process. */
+		swap_succ = shm_claim_page(page);
+		lock_release(&frame_lock);
+		return swap_succ;
+	}
 	struct frame *frame = vm_get_frame();
+	if(frame == NULL){
+		lock_release(&frame_lock);
+		return false;
+	}
 
 	bool success;
 
 	/* Set links */
 	frame->page = page;
+	frame->pml4 = t->pml4;
 	page->frame = frame;
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	success = pml4_set_page(t->pml4, page->va, frame->kva, page->writable);
-	if(!success) return false;
+	if(!success){
+		page->frame = NULL;
+		list_remove(&frame->elem);
+		palloc_free_page(frame->kva);
+		kmem_cache_free(frame_cachep, frame);
+		lock_release(&frame_lock);
+		return false;
+	}
 	
 	swap_succ = swap_in (page, frame->kva);
 	lock_release(&frame_lock);
@@ -350,11 +551,35 @@ supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		switch(page->operations->type)
 		{
 			case VM_UNINIT:
-				aux = malloc(sizeof(struct loading_datas));
+				if(VM_TYPE(page->uninit.type) == VM_SHARED)
+				{
+					if(!shm_fork_page(page))
+						return false;
+					break;
+				}
+
+				if(page->uninit.type & VM_SEGMENT)
+				{
+					/* The child's page loads from the same segment. */
+					struct segment *seg = page->uninit.aux;
+
+					if(!vm_alloc_page_with_initializer(page->uninit.type, page->va,
+						page->writable, page->uninit.init, seg))
+						return false;
+
+					/* The parent's pages drop their references
+					 * under frame_lock as they load or die. */
+					lock_acquire(&frame_lock);
+					seg->refcnt++;
+					lock_release(&frame_lock);
+					break;
+				}
+
+				aux = kmem_cache_alloc(loading_datas_cachep);
 				if(aux == NULL)
 					return false;
 
-				switch(page->uninit.type)
+				switch(VM_TYPE(page->uninit.type))
 				{
 					case VM_ANON:
 						parent_aux = page->uninit.aux;
@@ -365,7 +590,7 @@ supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 						
 						if(!vm_alloc_page_with_initializer(page->uninit.type, page->va, 
 							page->writable, page->uninit.init, aux)){
-							if(aux)	free(aux);
+							kmem_cache_free(loading_datas_cachep, aux);
 							return false;
 						}
 						break;
@@ -390,6 +615,12 @@ supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 			case VM_FILE:
 				break;
 
+			case VM_SHARED:
+				/* The child maps the same region, not a copy. */
+				if(!shm_fork_page(page))
+					return false;
+				break;
+
 			default:
 				return false;
 		}
@@ -403,7 +634,11 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
+	/* Take frame_lock once for the whole table rather than once
+	 * per page in vm_dealloc_page(). */
+	lock_acquire(&frame_lock);
 	hash_destroy(spt->pages, spt_destroy);
+	lock_release(&frame_lock);
 	free(spt->pages);
 }
 
@@ -428,6 +663,7 @@ static void
 spt_destroy(struct hash_elem *e, void *aux UNUSED)
 {
 	struct page *page = hash_entry(e, struct page, helem);
-	vm_dealloc_page(page);
+	destroy(page);
+	kmem_cache_free(page_cachep, page);
 }
 